@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2022  The OpenROAD Authors.
+#
+# Use of this source code is governed by a ISC-style
+# license that can be found in the LICENSE file or at
+# https://opensource.org/licenses/ISC
+#
+# SPDX-License-Identifier:ISC
+
+"""Generate a synthetic gate-level netlist for benchmarking orlo.
+
+The design is written as RTLIL made of Yosys internal gate cells ($_AND_,
+$_MUX_, $_DFF_P_, ...), the form orlo sees after techmap, so reading it back
+costs next to nothing compared to the passes being measured.
+
+The gates are split over many clock domains. Every odd domain shares the
+clock of the even one before it but adds an enable, and every third clock is
+a negedge clock. Each domain draws from a shared set of primary inputs and
+its own flip-flops, contains wide mux trees and a few combinational loops,
+and drives some primary outputs.
+"""
+
+import argparse
+import os
+import random
+import sys
+import tempfile
+
+LOGIC_2 = ["$_AND_", "$_OR_", "$_XOR_", "$_NAND_", "$_NOR_", "$_XNOR_", "$_ANDNOT_", "$_ORNOT_"]
+
+
+class Netlist:
+    def __init__(self, cells):
+        self.nsignals = 0
+        self.cells = cells
+
+    def signal(self):
+        self.nsignals += 1
+        return "$n%d" % (self.nsignals - 1)
+
+    def cell(self, kind, name, conns):
+        self.cells.write("  cell %s %s\n" % (kind, name))
+        for port, sig in conns:
+            self.cells.write("    connect \\%s %s\n" % (port, sig))
+        self.cells.write("  end\n")
+
+
+def default_domains(gates):
+    return min(256, max(4, gates // 4000))
+
+
+def generate(out, gates, domains, mux_width, loops, seed):
+    rng = random.Random(seed)
+    nclk = (domains + 1) // 2
+    nen = domains // 2
+    npi = min(1024, max(16, gates // 500))
+    per_domain = max(8, gates // domains)
+
+    with tempfile.TemporaryFile("w+") as cells:
+        net = Netlist(cells)
+        ports = []
+        outputs = []
+        pis = ["\\pi%d" % i for i in range(npi)]
+        ports += ["\\clk%d" % i for i in range(nclk)]
+        ports += ["\\en%d" % i for i in range(nen)]
+        ports += pis
+        ncell = 0
+
+        for d in range(domains):
+            clk = "\\clk%d" % (d // 2)
+            negedge = (d // 2) % 3 == 2
+            enable = "\\en%d" % (d // 2) if d % 2 == 1 else None
+            nff = max(1, per_domain // 20)
+            budget = per_domain - nff
+
+            qs = [net.signal() for _ in range(nff)]
+            pool = qs + rng.sample(pis, min(len(pis), 32))
+            recent = list(pool)
+
+            def pick():
+                # Mostly recent signals, so the logic gets some depth
+                if rng.random() < 0.8:
+                    return recent[-1 - rng.randrange(min(len(recent), 256))]
+                return rng.choice(pool)
+
+            def emit(kind, conns, y):
+                nonlocal ncell
+                net.cell(kind, "$g%d" % ncell, conns + [("Y", y)])
+                ncell += 1
+                recent.append(y)
+
+            while budget > 0:
+                r = rng.random()
+                if r < 0.1 / mux_width and budget >= mux_width - 1:
+                    # A balanced $_MUX_ tree with mux_width data inputs, about
+                    # a tenth of the gates end up in these
+                    level = [pick() for _ in range(mux_width)]
+                    selects = [pick() for _ in range(max(1, (mux_width - 1).bit_length()))]
+                    depth = 0
+                    while len(level) > 1:
+                        nxt = []
+                        for i in range(0, len(level) - 1, 2):
+                            y = net.signal()
+                            emit("$_MUX_", [("A", level[i]), ("B", level[i + 1]), ("S", selects[depth])], y)
+                            nxt.append(y)
+                            budget -= 1
+                        if len(level) % 2:
+                            nxt.append(level[-1])
+                        level = nxt
+                        depth += 1
+                elif r < 0.1 / mux_width + 0.002 * loops and budget >= 2:
+                    # A combinational loop of two gates
+                    a, b = net.signal(), net.signal()
+                    emit("$_AND_", [("A", pick()), ("B", b)], a)
+                    emit("$_OR_", [("A", a), ("B", pick())], b)
+                    budget -= 2
+                elif r < 0.06 + 0.002 * loops:
+                    emit("$_NOT_", [("A", pick())], net.signal())
+                    budget -= 1
+                else:
+                    emit(rng.choice(LOGIC_2), [("A", pick()), ("B", pick())], net.signal())
+                    budget -= 1
+
+            for q in qs:
+                conns = [("C", clk), ("D", pick())]
+                kind = "$_DFF_N_" if negedge else "$_DFF_P_"
+                if enable:
+                    kind = "$_DFFE_NP_" if negedge else "$_DFFE_PP_"
+                    conns.append(("E", enable))
+                net.cell(kind, "$f%d" % ncell, conns + [("Q", q)])
+                ncell += 1
+
+            for i in range(4):
+                outputs.append(recent[-1 - i])
+
+        out.write("# generated by gen_orlo_bench.py --gates %d --domains %d --mux-width %d --loops %d --seed %d\n"
+                  % (gates, domains, mux_width, loops, seed))
+        out.write("module \\top\n")
+        for i, name in enumerate(ports):
+            out.write("  wire input %d %s\n" % (i + 1, name))
+        for i in range(len(outputs)):
+            out.write("  wire output %d \\po%d\n" % (len(ports) + i + 1, i))
+        for i in range(net.nsignals):
+            out.write("  wire $n%d\n" % i)
+        cells.seek(0)
+        while True:
+            chunk = cells.read(1 << 20)
+            if not chunk:
+                break
+            out.write(chunk)
+        for i, sig in enumerate(outputs):
+            out.write("  connect \\po%d %s\n" % (i, sig))
+        out.write("end\n")
+        return ncell
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--gates", type=int, default=10000, help="number of gate and flip-flop cells")
+    parser.add_argument("--domains", type=int, help="number of clock/enable domains (default: gates/4000, 4 to 256)")
+    parser.add_argument("--mux-width", type=int, default=64, help="data inputs of the mux trees")
+    parser.add_argument("--loops", type=int, default=5, help="relative number of combinational loops")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", required=True, help="RTLIL file to write")
+    args = parser.parse_args()
+
+    domains = args.domains or default_domains(args.gates)
+    tmp = args.output + ".tmp"
+    with open(tmp, "w") as out:
+        ncell = generate(out, args.gates, domains, args.mux_width, args.loops, args.seed)
+    os.replace(tmp, args.output)
+    print("Wrote %d cells in %d domains to %s." % (ncell, domains, args.output), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2022  The OpenROAD Authors.
+#
+# Use of this source code is governed by a ISC-style
+# license that can be found in the LICENSE file or at
+# https://opensource.org/licenses/ISC
+#
+# SPDX-License-Identifier:ISC
+
+"""Benchmark orlo and orlo_reint on generated netlists.
+
+For every size a design is generated with gen_orlo_bench.py (and kept in the
+work directory for the next run). Then one Yosys process maps it with orlo
+and a second one reintegrates the results with orlo_reint, both with -stats.
+The phases of all jobs are summed up and compared against a baseline: a phase
+that got slower by more than the threshold is reported, and the script exits
+with status 1. Without a baseline file the results become the baseline.
+"""
+
+import argparse
+import glob
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+PHASES = ["partition", "extract", "loops", "write_blif", "abc", "read_blif", "simcheck", "reintegrate"]
+
+sys.path.insert(0, BENCH_DIR)
+import gen_orlo_bench  # noqa: E402
+
+
+def run_yosys(yosys, script, log):
+    start = time.monotonic()
+    with open(log, "w") as f:
+        ret = subprocess.call([yosys, "-q", "-s", script], stdout=f, stderr=subprocess.STDOUT)
+    if ret != 0:
+        sys.exit("%s failed with return code %d, see %s" % (script, ret, log))
+    return time.monotonic() - start
+
+
+def summarize(stats_file, wall):
+    with open(stats_file) as f:
+        stats = json.load(f)
+    summary = {phase: 0.0 for phase in PHASES}
+    summary["partition"] = sum(p["time"]["wall"] for p in stats["partition"])
+    for job in stats["jobs"]:
+        for phase, t in job["phases"].items():
+            summary[phase] += t["wall"]
+    summary["pass"] = stats["total"]["wall"]
+    summary["process"] = wall
+    summary["peak_rss_kb"] = stats["total"]["peak_rss_kb"]
+    summary["jobs"] = len(stats["jobs"])
+    return summary
+
+
+def bench(args, gates):
+    design = os.path.join(args.work, "bench_%d.il" % gates)
+    if not os.path.exists(design):
+        with open(design + ".tmp", "w") as out:
+            gen_orlo_bench.generate(out, gates, gen_orlo_bench.default_domains(gates), 64, 5, 1)
+        os.replace(design + ".tmp", design)
+
+    rundir = os.path.join(args.work, "run_%d" % gates)
+    shutil.rmtree(rundir, ignore_errors=True)
+    os.makedirs(rundir)
+
+    orlo_ys = os.path.join(rundir, "orlo.ys")
+    with open(orlo_ys, "w") as f:
+        f.write("plugin -i %s\n" % args.plugin)
+        f.write("read_rtlil %s\n" % design)
+        f.write("orlo %s -nocleanup -ondisk -abc_topdir %s -stats %s/orlo.json\n" % (args.orlo_args, rundir, rundir))
+    orlo_wall = run_yosys(args.yosys, orlo_ys, os.path.join(rundir, "orlo.log"))
+
+    abc_dirs = glob.glob(os.path.join(rundir, "yosys-abc-*"))
+    if len(abc_dirs) != 1:
+        sys.exit("Expected one abc work directory in %s" % rundir)
+
+    reint_ys = os.path.join(rundir, "reint.ys")
+    with open(reint_ys, "w") as f:
+        f.write("plugin -i %s\n" % args.plugin)
+        f.write("read_rtlil %s\n" % design)
+        f.write("orlo_reint %s -abc_dir %s -stats %s/reint.json\n" % (args.reint_args, abc_dirs[0], rundir))
+    reint_wall = run_yosys(args.yosys, reint_ys, os.path.join(rundir, "reint.log"))
+
+    result = {
+        "orlo": summarize(os.path.join(rundir, "orlo.json"), orlo_wall),
+        "orlo_reint": summarize(os.path.join(rundir, "reint.json"), reint_wall),
+    }
+    if not args.keep:
+        shutil.rmtree(rundir)
+    return result
+
+
+def report(results):
+    print("%-10s %-10s %s" % ("gates", "command", " ".join("%11s" % p for p in PHASES + ["pass"])))
+    for gates, result in sorted(results.items(), key=lambda it: int(it[0])):
+        for name, summary in sorted(result.items()):
+            print("%-10s %-10s %s" % (gates, name, " ".join("%10.3fs" % summary[p] for p in PHASES + ["pass"])))
+
+
+def compare(results, baseline, threshold, min_time):
+    regressions = []
+    for gates, result in results.items():
+        for name, summary in result.items():
+            base = baseline.get(gates, {}).get(name)
+            if base is None:
+                continue
+            for phase in PHASES + ["pass"]:
+                now, then = summary[phase], base.get(phase, 0.0)
+                if now > then * (1 + threshold) and now - then > min_time:
+                    regressions.append("%s gates, %s %s: %.3fs -> %.3fs (%+.0f%%)"
+                                       % (gates, name, phase, then, now, 100 * (now / then - 1) if then else 100))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--yosys", default="yosys")
+    parser.add_argument("--plugin", default="orlo", help="plugin to load, the name or the path of orlo.so")
+    parser.add_argument("--sizes", type=int, nargs="+", default=[10000, 100000, 1000000],
+                        help="gate counts of the generated designs")
+    parser.add_argument("--orlo-args", default="-dff -fast", help="options for orlo")
+    parser.add_argument("--reint-args", default="-dff", help="options for orlo_reint")
+    parser.add_argument("--work", default=os.path.join(BENCH_DIR, "work"), help="directory for designs and runs")
+    parser.add_argument("--baseline", default=os.path.join(BENCH_DIR, "baseline.json"))
+    parser.add_argument("--update-baseline", action="store_true", help="store the results as the new baseline")
+    parser.add_argument("--threshold", type=float, default=0.25, help="allowed slowdown of a phase (0.25 = 25%%)")
+    parser.add_argument("--min-time", type=float, default=0.1,
+                        help="ignore slowdowns of less than this many seconds")
+    parser.add_argument("--keep", action="store_true", help="keep the abc work directories and the logs")
+    args = parser.parse_args()
+
+    os.makedirs(args.work, exist_ok=True)
+    results = {}
+    for gates in args.sizes:
+        print("Benchmarking %d gates ..." % gates, file=sys.stderr)
+        results[str(gates)] = bench(args, gates)
+
+    with open(os.path.join(args.work, "results.json"), "w") as f:
+        json.dump(results, f, indent=2, sort_keys=True)
+    report(results)
+
+    if args.update_baseline or not os.path.exists(args.baseline):
+        baseline = {}
+        if os.path.exists(args.baseline):
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+        baseline.update(results)
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+        print("Stored the results as the baseline in %s." % args.baseline, file=sys.stderr)
+        return
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    regressions = compare(results, baseline, args.threshold, args.min_time)
+    for line in regressions:
+        print("REGRESSION: %s" % line)
+    if regressions:
+        sys.exit(1)
+    print("No regressions against %s." % args.baseline, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -83,6 +83,11 @@ variability in area and timing can be quite large. This change allows us to run
 strategies to create a set of viable alternatives with which we can then use to construct
 a better design.
 
+For the common case of picking the best of a few ABC scripts per clock domain,
+"orlo -strategies <file>" does this in one pass: every script is run on the
+same input.blif and only the result with the best area (or delay) is
+reintegrated.
+
 Note that the tests/techmap all pass (using orlo instead of abc) with the exception of
 mem_simple_4x1 which appears to be a pre-existing failure.
 
@@ -136,18 +141,36 @@ regression test in yosys/tests/techmap/abcreint.ys
 #include <sstream>
 #include <climits>
 #include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <sys/stat.h>
 
-#include <regex>
-std::regex orlo_badchars(R"~([\'\$\\])~");
-
 #ifndef _WIN32
 #  include <unistd.h>
 #  include <dirent.h>
 #endif
 
-#include "frontends/blif/blifparse.h"
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/resource.h>
+#  include <sys/wait.h>
+#  include <termios.h>
+#  include <time.h>
+#endif
+
+#include "libs/sha1/sha1.h"
+
+#ifdef YOSYS_ENABLE_ZLIB
+#  include <zlib.h>
+#endif
 
 #ifdef YOSYS_LINK_ABC
 extern "C" int Abc_RealMain(int argc, char *argv[]);
@@ -185,27 +208,259 @@ struct gate_t
 	gate_type_t type;
 	int in1, in2, in3, in4;
 	bool is_port;
+};
+
+// The signal driven by a gate. This is kept apart from the gate_t topology
+// that the loop breaking and the netlist writer walk over.
+struct gate_bit_t
+{
 	RTLIL::SigBit bit;
 	RTLIL::State init;
 };
 
+// Maps the bits of a module to the ids of their gates. A wire gets a dense
+// range of slots the first time one of its bits is mapped, so a lookup is a
+// single hash of the wire.
+struct orlo_signal_map_t
+{
+	dict<RTLIL::Wire*, int> wire_offset;
+	std::vector<int> ids;
+	dict<int, int> const_ids;
+
+	// The slot of a bit, -1 if it has no gate yet.
+	int &operator[](const RTLIL::SigBit &bit)
+	{
+		if (bit.wire == nullptr)
+			return const_ids.insert(std::make_pair(int(bit.data), -1)).first->second;
+		auto it = wire_offset.find(bit.wire);
+		if (it == wire_offset.end()) {
+			it = wire_offset.insert(std::make_pair(bit.wire, GetSize(ids))).first;
+			ids.resize(ids.size() + bit.wire->width, -1);
+		}
+		return ids[it->second + bit.offset];
+	}
+
+	int find(const RTLIL::SigBit &bit) const
+	{
+		if (bit.wire == nullptr) {
+			auto it = const_ids.find(int(bit.data));
+			return it == const_ids.end() ? -1 : it->second;
+		}
+		auto it = wire_offset.find(bit.wire);
+		return it == wire_offset.end() ? -1 : ids[it->second + bit.offset];
+	}
+
+	void clear()
+	{
+		wire_offset.clear();
+		const_ids.clear();
+		std::vector<int>().swap(ids);
+	}
+};
+
 bool map_mux4;
 bool map_mux8;
 bool map_mux16;
 
 bool markgroups;
-int map_autoidx;
-SigMap assign_map;
-RTLIL::Module *module;
-std::vector<gate_t> signal_list;
-std::map<RTLIL::SigBit, int> signal_map;
-FfInitVals initvals;
+bool blif_comments;
 pool<std::string> enabled_gates;
-bool recover_init, cmos_cost;
+bool cmos_cost;
+
+// -stats: the phases of a job that are timed. Reading output.blif creates
+// the cells as it goes, reintegrate is connecting them to the module.
+enum orlo_phase_t {
+	ORLO_PHASE_EXTRACT,
+	ORLO_PHASE_LOOPS,
+	ORLO_PHASE_WRITE_BLIF,
+	ORLO_PHASE_ABC,
+	ORLO_PHASE_READ_BLIF,
+	ORLO_PHASE_SIMCHECK,
+	ORLO_PHASE_REINTEGRATE,
+	ORLO_PHASE_COUNT
+};
+
+const char *orlo_phase_names[ORLO_PHASE_COUNT] = {
+	"extract", "loops", "write_blif", "abc", "read_blif", "simcheck", "reintegrate"
+};
+
+// -simcheck: how the output of a job compared against its extracted logic
+enum orlo_simcheck_result_t {
+	ORLO_SIMCHECK_NONE,
+	ORLO_SIMCHECK_MATCH,
+	ORLO_SIMCHECK_MISMATCH,
+	ORLO_SIMCHECK_UNCHECKED
+};
+
+struct orlo_phase_stats_t
+{
+	double wall = 0, cpu = 0;
+	long peak_rss_kb = 0;
+
+	void add(const orlo_phase_stats_t &other)
+	{
+		wall += other.wall;
+		cpu += other.cpu;
+		peak_rss_kb = std::max(peak_rss_kb, other.peak_rss_kb);
+	}
+};
+
+// Measures the wall time, the CPU time and the peak RSS of a phase. The CPU
+// time is that of the calling thread, so it is right on the worker threads
+// as well. With children it is that of the ABC processes that were waited
+// for in the meantime, which is only exact when ABC runs on one worker, and
+// the peak RSS is that of the biggest ABC process so far.
+struct orlo_phase_timer_t
+{
+	bool children;
+	std::chrono::steady_clock::time_point wall_start;
+	double cpu_start;
+
+	orlo_phase_timer_t(bool children = false) : children(children)
+	{
+		wall_start = std::chrono::steady_clock::now();
+		cpu_start = cpu_time();
+	}
+
+	double cpu_time() const
+	{
+#ifndef _WIN32
+		if (children) {
+			struct rusage ru;
+			getrusage(RUSAGE_CHILDREN, &ru);
+			return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + 1e-6 * (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+		}
+		struct timespec ts;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#else
+		return 0;
+#endif
+	}
+
+	orlo_phase_stats_t stop() const
+	{
+		orlo_phase_stats_t stats;
+		stats.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+		stats.cpu = cpu_time() - cpu_start;
+#ifndef _WIN32
+		struct rusage ru;
+		getrusage(children ? RUSAGE_CHILDREN : RUSAGE_SELF, &ru);
+		stats.peak_rss_kb = ru.ru_maxrss;
+#endif
+		return stats;
+	}
+};
+
+// One ABC run on the netlist of a job. Normally a job is its own only run.
+// With -strategies a job has one run per strategy, and the best of them is
+// moved into the job before it is reintegrated.
+struct orlo_abc_run_t
+{
+	std::string abc_script, output_blif;
+	std::string script_name = "abc.script", output_name = "output.blif";
+	std::string output_text;
+	std::string abc_command;
+	std::string cache_key;
+	bool cache_hit = false;
+	int abc_ret = 0;
+	std::vector<std::string> abc_output;
+	// -abc_pool: set if the ABC process could not be started at all
+	std::string start_error;
+	// -strategies: the strategy and the area and delay ABC reported for it
+	std::string strategy;
+	bool scored = false;
+	double area = 0, delay = 0;
+};
+
+// The extraction state of one module/clock domain. Every function that
+// extracts, maps or reintegrates logic works on one of these instead of on
+// file-scope state, so independent jobs can be processed concurrently.
+struct orlo_builtin_library_t;
+
+struct orlo_job_t : orlo_abc_run_t
+{
+	RTLIL::Module *module = nullptr;
+	int map_autoidx = 0;
+	SigMap assign_map;
+	FfInitVals initvals;
+	std::vector<gate_t> signal_list;
+	std::vector<gate_bit_t> signal_bits;
+	orlo_signal_map_t signal_map;
+	bool recover_init = false;
+	bool clk_polarity = true, en_polarity = true;
+	RTLIL::SigSpec clk_sig, en_sig;
+	dict<int, std::string> pi_map, po_map;
+	std::vector<RTLIL::Cell*> extracted_cells;
+	// The signals handle_loops() added to break loops, and the ones whose
+	// loops they broke
+	std::vector<std::pair<int, int>> loop_breaks;
+	std::string tempdir_name;
+	// -inmem: the files for ABC are never written to the temp dir, ABC's
+	// result is kept in output_text.
+	bool inmem = false;
+	// -compress: gzip input.blif and output.blif once ABC is done
+	bool compress = false;
+	// The generated library, without -liberty and -genlib
+	const orlo_builtin_library_t *library = nullptr;
+	// -blif_comments: the names of the signals, made while extracting as
+	// the worker threads must not look up names while the module changes
+	std::string blif_comments;
+	std::vector<orlo_abc_run_t> strategies;
+	// -incremental: the fingerprint of the extracted logic, and whether the
+	// output.blif of the previous run is used instead of running ABC
+	std::string fingerprint;
+	bool reused = false;
+	// orlo_reint: the domain is not in the manifest, orlo found it empty
+	bool unlisted = false;
+	// The key of the domain in the manifest, the hash of its input.blif
+	// and its part with -max_gates
+	std::string domain_key, input_hash;
+	int clk_domain = 0, part = 0;
+	int count_gates = 0, count_input = 0, count_output = 0;
+	orlo_simcheck_result_t simcheck_result = ORLO_SIMCHECK_NONE;
+	// -refine: the ABC script with {D} left in it, empty if the script has
+	// no {D}, and whether the refined run was faster
+	std::string delay_script;
+	bool refined = false;
+	std::string error;
+	orlo_phase_stats_t phases[ORLO_PHASE_COUNT];
+
+	orlo_job_t(RTLIL::Module *module) : module(module)
+	{
+		assign_map.set(module);
+		initvals.set(&assign_map, module);
+	}
+
+	// The SigMap and the init values are only needed during extraction and
+	// are the biggest part of a job, so they are dropped right after it.
+	void finish_extraction()
+	{
+		signal_map.clear();
+		initvals.clear();
+		assign_map.clear();
+	}
 
-bool clk_polarity, en_polarity;
-RTLIL::SigSpec clk_sig, en_sig;
-dict<int, std::string> pi_map, po_map;
+	// Drop the signal tables and the scripts and outputs of ABC once the
+	// job is reintegrated, so that only the domains in flight take up
+	// memory. The counts, names and phases stay for the statistics and
+	// the manifest.
+	void release()
+	{
+		std::vector<gate_t>().swap(signal_list);
+		std::vector<gate_bit_t>().swap(signal_bits);
+		dict<int, std::string>().swap(pi_map);
+		dict<int, std::string>().swap(po_map);
+		std::vector<RTLIL::Cell*>().swap(extracted_cells);
+		std::vector<std::pair<int, int>>().swap(loop_breaks);
+		std::string().swap(blif_comments);
+		std::string().swap(abc_script);
+		std::string().swap(delay_script);
+		std::string().swap(output_text);
+		std::vector<std::string>().swap(abc_output);
+		std::vector<orlo_abc_run_t>().swap(strategies);
+	}
+};
 
 inline bool exists(const std::string &name)
 {
@@ -213,26 +468,32 @@ inline bool exists(const std::string &name)
 	return (stat(name.c_str(), &buffer) == 0);
 }
 
-int map_signal(RTLIL::SigBit bit, gate_type_t gate_type = G(NONE), int in1 = -1, int in2 = -1, int in3 = -1, int in4 = -1)
+// -compress: the files that were gzipped have a .gz suffix
+inline bool is_gz(const std::string &name)
+{
+	return name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0;
+}
+
+int map_signal(orlo_job_t &job, RTLIL::SigBit bit, gate_type_t gate_type = G(NONE), int in1 = -1, int in2 = -1, int in3 = -1, int in4 = -1)
 {
-	assign_map.apply(bit);
+	job.assign_map.apply(bit);
 
-	if (signal_map.count(bit) == 0) {
+	int &id = job.signal_map[bit];
+	if (id < 0) {
 		gate_t gate;
-		gate.id = signal_list.size();
+		gate.id = job.signal_list.size();
 		gate.type = G(NONE);
 		gate.in1 = -1;
 		gate.in2 = -1;
 		gate.in3 = -1;
 		gate.in4 = -1;
 		gate.is_port = false;
-		gate.bit = bit;
-		gate.init = initvals(bit);
-		signal_list.push_back(gate);
-		signal_map[bit] = gate.id;
+		job.signal_list.push_back(gate);
+		job.signal_bits.push_back({bit, job.initvals(bit)});
+		id = gate.id;
 	}
 
-	gate_t &gate = signal_list[signal_map[bit]];
+	gate_t &gate = job.signal_list[id];
 
 	if (gate_type != G(NONE))
 		gate.type = gate_type;
@@ -248,36 +509,40 @@ int map_signal(RTLIL::SigBit bit, gate_type_t gate_type = G(NONE), int in1 = -1,
 	return gate.id;
 }
 
-void mark_port(RTLIL::SigSpec sig)
+void mark_port(orlo_job_t &job, RTLIL::SigSpec sig)
 {
-	for (auto &bit : assign_map(sig))
-		if (bit.wire != nullptr && signal_map.count(bit) > 0)
-			signal_list[signal_map[bit]].is_port = true;
+	for (auto &bit : job.assign_map(sig)) {
+		if (bit.wire == nullptr)
+			continue;
+		int id = job.signal_map.find(bit);
+		if (id >= 0)
+			job.signal_list[id].is_port = true;
+	}
 }
 
-void extract_cell(RTLIL::Cell *cell, bool keepff)
+bool extract_cell(orlo_job_t &job, RTLIL::Cell *cell, bool keepff)
 {
 	if (cell->type.in(ID($_DFF_N_), ID($_DFF_P_)))
 	{
-		if (clk_polarity != (cell->type == ID($_DFF_P_)))
-			return;
-		if (clk_sig != assign_map(cell->getPort(ID::C)))
-			return;
-		if (GetSize(en_sig) != 0)
-			return;
+		if (job.clk_polarity != (cell->type == ID($_DFF_P_)))
+			return false;
+		if (job.clk_sig != job.assign_map(cell->getPort(ID::C)))
+			return false;
+		if (GetSize(job.en_sig) != 0)
+			return false;
 		goto matching_dff;
 	}
 
 	if (cell->type.in(ID($_DFFE_NN_), ID($_DFFE_NP_), ID($_DFFE_PN_), ID($_DFFE_PP_)))
 	{
-		if (clk_polarity != cell->type.in(ID($_DFFE_PN_), ID($_DFFE_PP_)))
-			return;
-		if (en_polarity != cell->type.in(ID($_DFFE_NP_), ID($_DFFE_PP_)))
-			return;
-		if (clk_sig != assign_map(cell->getPort(ID::C)))
-			return;
-		if (en_sig != assign_map(cell->getPort(ID::E)))
-			return;
+		if (job.clk_polarity != cell->type.in(ID($_DFFE_PN_), ID($_DFFE_PP_)))
+			return false;
+		if (job.en_polarity != cell->type.in(ID($_DFFE_NP_), ID($_DFFE_PP_)))
+			return false;
+		if (job.clk_sig != job.assign_map(cell->getPort(ID::C)))
+			return false;
+		if (job.en_sig != job.assign_map(cell->getPort(ID::E)))
+			return false;
 		goto matching_dff;
 	}
 
@@ -291,13 +556,12 @@ void extract_cell(RTLIL::Cell *cell, bool keepff)
 				if (c.wire != nullptr)
 					c.wire->attributes[ID::keep] = 1;
 
-		assign_map.apply(sig_d);
-		assign_map.apply(sig_q);
+		job.assign_map.apply(sig_d);
+		job.assign_map.apply(sig_q);
 
-		map_signal(sig_q, G(FF), map_signal(sig_d));
+		map_signal(job, sig_q, G(FF), map_signal(job, sig_d));
 
-		module->remove(cell);
-		return;
+		return true;
 	}
 
 	if (cell->type.in(ID($_BUF_), ID($_NOT_)))
@@ -305,13 +569,12 @@ void extract_cell(RTLIL::Cell *cell, bool keepff)
 		RTLIL::SigSpec sig_a = cell->getPort(ID::A);
 		RTLIL::SigSpec sig_y = cell->getPort(ID::Y);
 
-		assign_map.apply(sig_a);
-		assign_map.apply(sig_y);
+		job.assign_map.apply(sig_a);
+		job.assign_map.apply(sig_y);
 
-		map_signal(sig_y, cell->type == ID($_BUF_) ? G(BUF) : G(NOT), map_signal(sig_a));
+		map_signal(job, sig_y, cell->type == ID($_BUF_) ? G(BUF) : G(NOT), map_signal(job, sig_a));
 
-		module->remove(cell);
-		return;
+		return true;
 	}
 
 	if (cell->type.in(ID($_AND_), ID($_NAND_), ID($_OR_), ID($_NOR_), ID($_XOR_), ID($_XNOR_), ID($_ANDNOT_), ID($_ORNOT_)))
@@ -320,34 +583,33 @@ void extract_cell(RTLIL::Cell *cell, bool keepff)
 		RTLIL::SigSpec sig_b = cell->getPort(ID::B);
 		RTLIL::SigSpec sig_y = cell->getPort(ID::Y);
 
-		assign_map.apply(sig_a);
-		assign_map.apply(sig_b);
-		assign_map.apply(sig_y);
+		job.assign_map.apply(sig_a);
+		job.assign_map.apply(sig_b);
+		job.assign_map.apply(sig_y);
 
-		int mapped_a = map_signal(sig_a);
-		int mapped_b = map_signal(sig_b);
+		int mapped_a = map_signal(job, sig_a);
+		int mapped_b = map_signal(job, sig_b);
 
 		if (cell->type == ID($_AND_))
-			map_signal(sig_y, G(AND), mapped_a, mapped_b);
+			map_signal(job, sig_y, G(AND), mapped_a, mapped_b);
 		else if (cell->type == ID($_NAND_))
-			map_signal(sig_y, G(NAND), mapped_a, mapped_b);
+			map_signal(job, sig_y, G(NAND), mapped_a, mapped_b);
 		else if (cell->type == ID($_OR_))
-			map_signal(sig_y, G(OR), mapped_a, mapped_b);
+			map_signal(job, sig_y, G(OR), mapped_a, mapped_b);
 		else if (cell->type == ID($_NOR_))
-			map_signal(sig_y, G(NOR), mapped_a, mapped_b);
+			map_signal(job, sig_y, G(NOR), mapped_a, mapped_b);
 		else if (cell->type == ID($_XOR_))
-			map_signal(sig_y, G(XOR), mapped_a, mapped_b);
+			map_signal(job, sig_y, G(XOR), mapped_a, mapped_b);
 		else if (cell->type == ID($_XNOR_))
-			map_signal(sig_y, G(XNOR), mapped_a, mapped_b);
+			map_signal(job, sig_y, G(XNOR), mapped_a, mapped_b);
 		else if (cell->type == ID($_ANDNOT_))
-			map_signal(sig_y, G(ANDNOT), mapped_a, mapped_b);
+			map_signal(job, sig_y, G(ANDNOT), mapped_a, mapped_b);
 		else if (cell->type == ID($_ORNOT_))
-			map_signal(sig_y, G(ORNOT), mapped_a, mapped_b);
+			map_signal(job, sig_y, G(ORNOT), mapped_a, mapped_b);
 		else
 			log_abort();
 
-		module->remove(cell);
-		return;
+		return true;
 	}
 
 	if (cell->type.in(ID($_MUX_), ID($_NMUX_)))
@@ -357,19 +619,18 @@ void extract_cell(RTLIL::Cell *cell, bool keepff)
 		RTLIL::SigSpec sig_s = cell->getPort(ID::S);
 		RTLIL::SigSpec sig_y = cell->getPort(ID::Y);
 
-		assign_map.apply(sig_a);
-		assign_map.apply(sig_b);
-		assign_map.apply(sig_s);
-		assign_map.apply(sig_y);
+		job.assign_map.apply(sig_a);
+		job.assign_map.apply(sig_b);
+		job.assign_map.apply(sig_s);
+		job.assign_map.apply(sig_y);
 
-		int mapped_a = map_signal(sig_a);
-		int mapped_b = map_signal(sig_b);
-		int mapped_s = map_signal(sig_s);
+		int mapped_a = map_signal(job, sig_a);
+		int mapped_b = map_signal(job, sig_b);
+		int mapped_s = map_signal(job, sig_s);
 
-		map_signal(sig_y, cell->type == ID($_MUX_) ? G(MUX) : G(NMUX), mapped_a, mapped_b, mapped_s);
+		map_signal(job, sig_y, cell->type == ID($_MUX_) ? G(MUX) : G(NMUX), mapped_a, mapped_b, mapped_s);
 
-		module->remove(cell);
-		return;
+		return true;
 	}
 
 	if (cell->type.in(ID($_AOI3_), ID($_OAI3_)))
@@ -379,19 +640,18 @@ void extract_cell(RTLIL::Cell *cell, bool keepff)
 		RTLIL::SigSpec sig_c = cell->getPort(ID::C);
 		RTLIL::SigSpec sig_y = cell->getPort(ID::Y);
 
-		assign_map.apply(sig_a);
-		assign_map.apply(sig_b);
-		assign_map.apply(sig_c);
-		assign_map.apply(sig_y);
+		job.assign_map.apply(sig_a);
+		job.assign_map.apply(sig_b);
+		job.assign_map.apply(sig_c);
+		job.assign_map.apply(sig_y);
 
-		int mapped_a = map_signal(sig_a);
-		int mapped_b = map_signal(sig_b);
-		int mapped_c = map_signal(sig_c);
+		int mapped_a = map_signal(job, sig_a);
+		int mapped_b = map_signal(job, sig_b);
+		int mapped_c = map_signal(job, sig_c);
 
-		map_signal(sig_y, cell->type == ID($_AOI3_) ? G(AOI3) : G(OAI3), mapped_a, mapped_b, mapped_c);
+		map_signal(job, sig_y, cell->type == ID($_AOI3_) ? G(AOI3) : G(OAI3), mapped_a, mapped_b, mapped_c);
 
-		module->remove(cell);
-		return;
+		return true;
 	}
 
 	if (cell->type.in(ID($_AOI4_), ID($_OAI4_)))
@@ -402,25 +662,27 @@ void extract_cell(RTLIL::Cell *cell, bool keepff)
 		RTLIL::SigSpec sig_d = cell->getPort(ID::D);
 		RTLIL::SigSpec sig_y = cell->getPort(ID::Y);
 
-		assign_map.apply(sig_a);
-		assign_map.apply(sig_b);
-		assign_map.apply(sig_c);
-		assign_map.apply(sig_d);
-		assign_map.apply(sig_y);
+		job.assign_map.apply(sig_a);
+		job.assign_map.apply(sig_b);
+		job.assign_map.apply(sig_c);
+		job.assign_map.apply(sig_d);
+		job.assign_map.apply(sig_y);
 
-		int mapped_a = map_signal(sig_a);
-		int mapped_b = map_signal(sig_b);
-		int mapped_c = map_signal(sig_c);
-		int mapped_d = map_signal(sig_d);
+		int mapped_a = map_signal(job, sig_a);
+		int mapped_b = map_signal(job, sig_b);
+		int mapped_c = map_signal(job, sig_c);
+		int mapped_d = map_signal(job, sig_d);
 
-		map_signal(sig_y, cell->type == ID($_AOI4_) ? G(AOI4) : G(OAI4), mapped_a, mapped_b, mapped_c, mapped_d);
+		map_signal(job, sig_y, cell->type == ID($_AOI4_) ? G(AOI4) : G(OAI4), mapped_a, mapped_b, mapped_c, mapped_d);
 
-		module->remove(cell);
-		return;
+		return true;
 	}
+
+	return false;
 }
 
-std::string remap_name(RTLIL::IdString abc_name, RTLIL::Wire **orig_wire = nullptr)
+// Map an (escaped) name in the ABC output back to the design.
+std::string remap_net_name(orlo_job_t &job, const std::string &abc_name, RTLIL::Wire **orig_wire = nullptr)
 {
 	std::string abc_sname = abc_name.substr(1);
 	bool isnew = false;
@@ -438,12 +700,12 @@ std::string remap_name(RTLIL::IdString abc_name, RTLIL::Wire **orig_wire = nullp
 			size_t postfix_start = abc_sname.find_first_not_of("0123456789");
 			std::string postfix = postfix_start != std::string::npos ? abc_sname.substr(postfix_start) : "";
 
-			if (sid < GetSize(signal_list))
+			if (sid < GetSize(job.signal_list))
 			{
-				auto sig = signal_list.at(sid);
+				auto &sig = job.signal_bits.at(sid);
 				if (sig.bit.wire != nullptr)
 				{
-					std::string s = stringf("$abc$%d$%s", map_autoidx, sig.bit.wire->name.c_str()+1);
+					std::string s = stringf("$abc$%d$%s", job.map_autoidx, sig.bit.wire->name.c_str()+1);
 					if (sig.bit.wire->width != 1)
 						s += stringf("[%d]", sig.bit.offset);
 					if (isnew)
@@ -456,10 +718,47 @@ std::string remap_name(RTLIL::IdString abc_name, RTLIL::Wire **orig_wire = nullp
 			}
 		}
 	}
-	return stringf("$abc$%d$%s", map_autoidx, abc_name.c_str()+1);
+	return stringf("$abc$%d$%s", job.map_autoidx, abc_name.c_str()+1);
+}
+
+std::string remap_name(orlo_job_t &job, RTLIL::IdString abc_name, RTLIL::Wire **orig_wire = nullptr)
+{
+	return remap_net_name(job, abc_name.str(), orig_wire);
+}
+
+// The fanout of the gates of a job as a compressed adjacency array. Every
+// gate id has a row of the gates it drives, a gate that replaces another one
+// when a loop is broken takes over its row.
+struct orlo_loop_graph_t
+{
+	std::vector<int> edge_begin, edge_list;
+	std::vector<int> row, in_edges_count;
+	std::vector<bool> done;
+
+	int fanout(int id) const
+	{
+		return row[id] < 0 ? 0 : edge_begin[row[id]+1] - edge_begin[row[id]];
+	}
+
+	const int *begin(int id) const { return edge_list.data() + (row[id] < 0 ? 0 : edge_begin[row[id]]); }
+	const int *end(int id) const { return begin(id) + fanout(id); }
+};
+
+// The distinct inputs of a gate, each one is an edge of the loop graph.
+int orlo_gate_inputs(const gate_t &g, int *inputs)
+{
+	int n = 0;
+	if (g.type == G(NONE) || g.type == G(FF))
+		return n;
+	for (int in : {g.in1, g.in2, g.in3, g.in4}) {
+		if (in < 0 || std::find(inputs, inputs + n, in) != inputs + n)
+			continue;
+		inputs[n++] = in;
+	}
+	return n;
 }
 
-void dump_loop_graph(FILE *f, int &nr, std::map<int, std::set<int>> &edges, std::set<int> &workpool, std::vector<int> &in_counts)
+void dump_loop_graph(orlo_job_t &job, FILE *f, int &nr, const orlo_loop_graph_t &graph)
 {
 	if (f == nullptr)
 		return;
@@ -471,31 +770,37 @@ void dump_loop_graph(FILE *f, int &nr, std::map<int, std::set<int>> &edges, std:
 	fprintf(f, "  rankdir=\"TD\";\n");
 
 	std::set<int> nodes;
-	for (auto &e : edges) {
-		nodes.insert(e.first);
-		for (auto n : e.second)
-			nodes.insert(n);
+	for (int id = 0; id < GetSize(graph.row); id++) {
+		if (graph.done[id] || graph.fanout(id) == 0)
+			continue;
+		nodes.insert(id);
+		nodes.insert(graph.begin(id), graph.end(id));
 	}
 
 	for (auto n : nodes)
-		fprintf(f, "  ys__n%d [label=\"%s\\nid=%d, count=%d\"%s];\n", n, log_signal(signal_list[n].bit),
-				n, in_counts[n], workpool.count(n) ? ", shape=box" : "");
+		fprintf(f, "  ys__n%d [label=\"%s\\nid=%d, count=%d\"%s];\n", n, log_signal(job.signal_bits[n].bit),
+				n, graph.in_edges_count[n], !graph.done[n] && graph.in_edges_count[n] == 0 ? ", shape=box" : "");
 
-	for (auto &e : edges)
-	for (auto n : e.second)
-		fprintf(f, "  ys__n%d -> ys__n%d;\n", e.first, n);
+	for (auto n : nodes)
+		if (!graph.done[n])
+			for (auto it = graph.begin(n); it != graph.end(n); it++)
+				fprintf(f, "  ys__n%d -> ys__n%d;\n", n, *it);
 
 	fprintf(f, "}\n");
 }
 
-void handle_loops()
+void handle_loops(orlo_job_t &job)
 {
 	// http://en.wikipedia.org/wiki/Topological_sorting
 	// (Kahn, Arthur B. (1962), "Topological sorting of large networks")
 
-	std::map<int, std::set<int>> edges;
-	std::vector<int> in_edges_count(signal_list.size());
-	std::set<int> workpool;
+	int nodes = GetSize(job.signal_list);
+	orlo_loop_graph_t graph;
+	graph.edge_begin.resize(nodes+1);
+	graph.row.resize(nodes);
+	graph.in_edges_count.resize(nodes);
+	graph.done.resize(nodes);
+	std::vector<int> workpool;
 
 	FILE *dot_f = nullptr;
 	int dot_nr = 0;
@@ -503,117 +808,125 @@ void handle_loops()
 	// uncomment for troubleshooting the loop detection code
 	// dot_f = fopen("test.dot", "w");
 
-	for (auto &g : signal_list) {
-		if (g.type == G(NONE) || g.type == G(FF)) {
-			workpool.insert(g.id);
-		} else {
-			if (g.in1 >= 0) {
-				edges[g.in1].insert(g.id);
-				in_edges_count[g.id]++;
-			}
-			if (g.in2 >= 0 && g.in2 != g.in1) {
-				edges[g.in2].insert(g.id);
-				in_edges_count[g.id]++;
-			}
-			if (g.in3 >= 0 && g.in3 != g.in2 && g.in3 != g.in1) {
-				edges[g.in3].insert(g.id);
-				in_edges_count[g.id]++;
-			}
-			if (g.in4 >= 0 && g.in4 != g.in3 && g.in4 != g.in2 && g.in4 != g.in1) {
-				edges[g.in4].insert(g.id);
-				in_edges_count[g.id]++;
-			}
-		}
+	int inputs[4];
+	for (auto &g : job.signal_list) {
+		int n = orlo_gate_inputs(g, inputs);
+		for (int i = 0; i < n; i++)
+			graph.edge_begin[inputs[i]+1]++;
+		graph.in_edges_count[g.id] = n;
+		if (g.type == G(NONE) || g.type == G(FF))
+			workpool.push_back(g.id);
+	}
+	for (int id = 0; id < nodes; id++) {
+		graph.edge_begin[id+1] += graph.edge_begin[id];
+		graph.row[id] = id;
+	}
+	graph.edge_list.resize(graph.edge_begin[nodes]);
+	std::vector<int> edge_fill(graph.edge_begin.begin(), graph.edge_begin.end() - 1);
+	for (auto &g : job.signal_list) {
+		int n = orlo_gate_inputs(g, inputs);
+		for (int i = 0; i < n; i++)
+			graph.edge_list[edge_fill[inputs[i]]++] = g.id;
 	}
 
-	dump_loop_graph(dot_f, dot_nr, edges, workpool, in_edges_count);
+	// The order in which loops are broken: gates with a wire before constants,
+	// public before internal names, large fanout first, then by name. The
+	// fanout of a gate does not change until it is done or its loop is broken,
+	// so the order can be computed once and is walked with a single cursor.
+	std::vector<int> candidates;
+	for (int id = 0; id < nodes; id++)
+		if (graph.fanout(id) > 0)
+			candidates.push_back(id);
+	std::sort(candidates.begin(), candidates.end(), [&](int id1, int id2) {
+		RTLIL::Wire *w1 = job.signal_bits[id1].bit.wire;
+		RTLIL::Wire *w2 = job.signal_bits[id2].bit.wire;
+		if (w1 == nullptr || w2 == nullptr)
+			return w1 == nullptr && w2 == nullptr ? id1 > id2 : w2 == nullptr;
+		bool pub1 = w1->name.c_str()[0] == '\\', pub2 = w2->name.c_str()[0] == '\\';
+		if (pub1 != pub2)
+			return pub1;
+		if (graph.fanout(id1) != graph.fanout(id2))
+			return graph.fanout(id1) > graph.fanout(id2);
+		int cmp = strcmp(w1->name.c_str(), w2->name.c_str());
+		return cmp != 0 ? cmp < 0 : id1 < id2;
+	});
+	size_t next_candidate = 0;
+
+	dump_loop_graph(job, dot_f, dot_nr, graph);
 
 	while (workpool.size() > 0)
 	{
-		int id = *workpool.begin();
-		workpool.erase(id);
+		int id = workpool.back();
+		workpool.pop_back();
+		graph.done[id] = true;
 
-		// log("Removing non-loop node %d from graph: %s\n", id, log_signal(signal_list[id].bit));
+		// log("Removing non-loop node %d from graph: %s\n", id, log_signal(signal_bits[id].bit));
 
-		for (int id2 : edges[id]) {
-			log_assert(in_edges_count[id2] > 0);
-			if (--in_edges_count[id2] == 0)
-				workpool.insert(id2);
+		for (auto it = graph.begin(id); it != graph.end(id); it++) {
+			log_assert(graph.in_edges_count[*it] > 0);
+			if (--graph.in_edges_count[*it] == 0)
+				workpool.push_back(*it);
 		}
-		edges.erase(id);
 
-		dump_loop_graph(dot_f, dot_nr, edges, workpool, in_edges_count);
+		if (dot_f != nullptr)
+			dump_loop_graph(job, dot_f, dot_nr, graph);
 
-		while (workpool.size() == 0)
+		if (workpool.size() == 0)
 		{
-			if (edges.size() == 0)
-				break;
-
-			int id1 = edges.begin()->first;
-
-			for (auto &edge_it : edges) {
-				int id2 = edge_it.first;
-				RTLIL::Wire *w1 = signal_list[id1].bit.wire;
-				RTLIL::Wire *w2 = signal_list[id2].bit.wire;
-				if (w1 == nullptr)
-					id1 = id2;
-				else if (w2 == nullptr)
-					continue;
-				else if (w1->name[0] == '$' && w2->name[0] == '\\')
-					id1 = id2;
-				else if (w1->name[0] == '\\' && w2->name[0] == '$')
-					continue;
-				else if (edges[id1].size() < edges[id2].size())
-					id1 = id2;
-				else if (edges[id1].size() > edges[id2].size())
-					continue;
-				else if (w2->name.str() < w1->name.str())
-					id1 = id2;
+			while (next_candidate < candidates.size()) {
+				int cand = candidates[next_candidate];
+				if (!graph.done[cand] && graph.fanout(cand) > 0)
+					break;
+				next_candidate++;
 			}
+			if (next_candidate == candidates.size())
+				break;
 
-			if (edges[id1].size() == 0) {
-				edges.erase(id1);
-				continue;
-			}
+			int id1 = candidates[next_candidate++];
 
-			log_assert(signal_list[id1].bit.wire != nullptr);
+			log_assert(job.signal_bits[id1].bit.wire != nullptr);
 
 			std::stringstream sstr;
 			sstr << "$abcloop$" << (autoidx++);
-			RTLIL::Wire *wire = module->addWire(sstr.str());
+			RTLIL::Wire *wire = job.module->addWire(sstr.str());
 
 			bool first_line = true;
-			for (int id2 : edges[id1]) {
+			for (auto it = graph.begin(id1); it != graph.end(id1); it++) {
 				if (first_line)
 					log("Breaking loop using new signal %s: %s -> %s\n", log_signal(RTLIL::SigSpec(wire)),
-							log_signal(signal_list[id1].bit), log_signal(signal_list[id2].bit));
+							log_signal(job.signal_bits[id1].bit), log_signal(job.signal_bits[*it].bit));
 				else
 					log("                               %*s  %s -> %s\n", int(strlen(log_signal(RTLIL::SigSpec(wire)))), "",
-							log_signal(signal_list[id1].bit), log_signal(signal_list[id2].bit));
+							log_signal(job.signal_bits[id1].bit), log_signal(job.signal_bits[*it].bit));
 				first_line = false;
 			}
 
-			int id3 = map_signal(RTLIL::SigSpec(wire));
-			signal_list[id1].is_port = true;
-			signal_list[id3].is_port = true;
-			log_assert(id3 == int(in_edges_count.size()));
-			in_edges_count.push_back(0);
-			workpool.insert(id3);
-
-			for (int id2 : edges[id1]) {
-				if (signal_list[id2].in1 == id1)
-					signal_list[id2].in1 = id3;
-				if (signal_list[id2].in2 == id1)
-					signal_list[id2].in2 = id3;
-				if (signal_list[id2].in3 == id1)
-					signal_list[id2].in3 = id3;
-				if (signal_list[id2].in4 == id1)
-					signal_list[id2].in4 = id3;
+			int id3 = map_signal(job, RTLIL::SigSpec(wire));
+			job.signal_list[id1].is_port = true;
+			job.signal_list[id3].is_port = true;
+			log_assert(id3 == GetSize(graph.row));
+			graph.row.push_back(graph.row[id1]);
+			graph.in_edges_count.push_back(0);
+			graph.done.push_back(false);
+			graph.row[id1] = -1;
+			workpool.push_back(id3);
+
+			for (auto it = graph.begin(id3); it != graph.end(id3); it++) {
+				gate_t &g = job.signal_list[*it];
+				if (g.in1 == id1)
+					g.in1 = id3;
+				if (g.in2 == id1)
+					g.in2 = id3;
+				if (g.in3 == id1)
+					g.in3 = id3;
+				if (g.in4 == id1)
+					g.in4 = id3;
 			}
-			edges[id1].swap(edges[id3]);
 
-			module->connect(RTLIL::SigSig(signal_list[id3].bit, signal_list[id1].bit));
-			dump_loop_graph(dot_f, dot_nr, edges, workpool, in_edges_count);
+			job.module->connect(RTLIL::SigSig(job.signal_bits[id3].bit, job.signal_bits[id1].bit));
+			job.loop_breaks.push_back(std::make_pair(id3, id1));
+			if (dot_f != nullptr)
+				dump_loop_graph(job, dot_f, dot_nr, graph);
 		}
 	}
 
@@ -692,15 +1005,17 @@ struct abc_output_filter
 	bool got_cr;
 	int escape_seq_state;
 	std::string linebuf;
-	std::string tempdir_name;
-	bool show_tempdir;
+	const orlo_job_t *job;
+	std::vector<std::string> *lines;
 
-	abc_output_filter(std::string tempdir_name, bool show_tempdir) : tempdir_name(tempdir_name), show_tempdir(show_tempdir)
+	abc_output_filter(const orlo_job_t *job, std::vector<std::string> *lines) : job(job), lines(lines)
 	{
 		got_cr = false;
 		escape_seq_state = 0;
 	}
 
+	// This runs on the ABC worker threads, so instead of logging the lines
+	// they are collected in the run and logged once the job is finished.
 	void next_char(char ch)
 	{
 		if (escape_seq_state == 0 && ch == '\033') {
@@ -722,7 +1037,7 @@ struct abc_output_filter
 			return;
 		}
 		if (ch == '\n') {
-			log("ABC: %s\n", replace_tempdir(linebuf, tempdir_name, show_tempdir).c_str());
+			lines->push_back(linebuf);
 			got_cr = false, linebuf.clear();
 			return;
 		}
@@ -735,9 +1050,23 @@ struct abc_output_filter
 	{
 		int pi, po;
 		if (sscanf(line.c_str(), "Start-point = pi%d.  End-point = po%d.", &pi, &po) == 2) {
-			log("ABC: Start-point = pi%d (%s).  End-point = po%d (%s).\n",
-					pi, pi_map.count(pi) ? pi_map.at(pi).c_str() : "???",
-					po, po_map.count(po) ? po_map.at(po).c_str() : "???");
+			lines->push_back(stringf("Start-point = pi%d (%s).  End-point = po%d (%s).",
+					pi, job->pi_map.count(pi) ? job->pi_map.at(pi).c_str() : "???",
+					po, job->po_map.count(po) ? job->po_map.at(po).c_str() : "???"));
+			return;
+		}
+
+		// Most lines have no escape sequences or carriage returns, those
+		// are split at the newlines without going through next_char().
+		if (escape_seq_state == 0 && !got_cr && line.find_first_of("\033\r") == std::string::npos) {
+			size_t start = 0;
+			for (size_t nl = line.find('\n'); nl != std::string::npos; nl = line.find('\n', start)) {
+				linebuf.append(line, start, nl - start);
+				lines->push_back(linebuf);
+				linebuf.clear();
+				start = nl + 1;
+			}
+			linebuf.append(line, start, std::string::npos);
 			return;
 		}
 
@@ -747,363 +1076,1088 @@ struct abc_output_filter
 };
 
 
-void orlo_reintegrate(RTLIL::Design *design,
-                     RTLIL::Module *current_module,
-                     const std::vector<std::string> &liberty_files,
-                     const std::vector<std::string> &genlib_files,
-                     bool sop_mode,
-		             std::string tempdir_name)
+// A read-only view of ABC's output.blif. The file is mapped into memory, with
+// -inmem the text that was read back into the job is used as is.
+struct orlo_blif_text_t
 {
-	module = current_module;
+	const char *data = nullptr;
+	size_t size = 0;
+	void *mapped = nullptr;
+	std::string buffer;
 
-	std::string buffer = stringf("%s/%s", tempdir_name.c_str(), "output.blif");
+	orlo_blif_text_t() { }
+	orlo_blif_text_t(const orlo_blif_text_t&) = delete;
+	orlo_blif_text_t &operator=(const orlo_blif_text_t&) = delete;
 
-	// Some modules are empty and do not have output.blif files.  We need a better way
-	// to check for these empty modules, but this will have to do for now.
-	if (!exists(buffer)) {
-		log("ABC file %s doesn't exist.  Skipping.\n", buffer.c_str());
-		return;
+	~orlo_blif_text_t()
+	{
+		clear();
 	}
 
-		std::ifstream ifs;
-		ifs.open(buffer);
-		if (ifs.fail())
-			log_error("Can't open ABC output file `%s'.\n", buffer.c_str());
-
-		bool builtin_lib = liberty_files.empty() && genlib_files.empty();
-		RTLIL::Design *mapped_design = new RTLIL::Design;
-		parse_blif(mapped_design, ifs, builtin_lib ? ID(DFF) : ID(_dff_), false, sop_mode);
-
-		ifs.close();
-
-		log_header(design, "Re-integrating ABC results.\n");
-		RTLIL::Module *mapped_mod = mapped_design->module(ID(netlist));
-		if (mapped_mod == nullptr)
-			log_error("ABC output file does not contain a module `netlist'.\n");
-		for (auto w : mapped_mod->wires()) {
-			RTLIL::Wire *orig_wire = nullptr;
-			RTLIL::Wire *wire = module->addWire(remap_name(w->name, &orig_wire));
-			if (orig_wire != nullptr && orig_wire->attributes.count(ID::src))
-				wire->attributes[ID::src] = orig_wire->attributes[ID::src];
-			if (markgroups) wire->attributes[ID::abcgroup] = map_autoidx;
-			design->select(module, wire);
-		}
+	void clear()
+	{
+#ifndef _WIN32
+		if (mapped != nullptr)
+			munmap(mapped, size);
+#endif
+		mapped = nullptr;
+		data = nullptr;
+		size = 0;
+		std::string().swap(buffer);
+	}
 
-		std::map<std::string, int> cell_stats;
-		for (auto c : mapped_mod->cells())
-		{
-			if (builtin_lib)
-			{
-				cell_stats[RTLIL::unescape_id(c->type)]++;
-				if (c->type.in(ID(ZERO), ID(ONE))) {
-					RTLIL::SigSig conn;
-					RTLIL::IdString name_y = remap_name(c->getPort(ID::Y).as_wire()->name);
-					conn.first = module->wire(name_y);
-					conn.second = RTLIL::SigSpec(c->type == ID(ZERO) ? 0 : 1, 1);
-					module->connect(conn);
-					continue;
-				}
-				if (c->type == ID(BUF)) {
-					RTLIL::SigSig conn;
-					RTLIL::IdString name_y = remap_name(c->getPort(ID::Y).as_wire()->name);
-					RTLIL::IdString name_a = remap_name(c->getPort(ID::A).as_wire()->name);
-					conn.first = module->wire(name_y);
-					conn.second = module->wire(name_a);
-					module->connect(conn);
-					continue;
-				}
-				if (c->type == ID(NOT)) {
-					RTLIL::Cell *cell = module->addCell(remap_name(c->name), ID($_NOT_));
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::A, ID::Y}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					design->select(module, cell);
-					continue;
-				}
-				if (c->type.in(ID(AND), ID(OR), ID(XOR), ID(NAND), ID(NOR), ID(XNOR), ID(ANDNOT), ID(ORNOT))) {
-					RTLIL::Cell *cell = module->addCell(remap_name(c->name), stringf("$_%s_", c->type.c_str()+1));
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::A, ID::B, ID::Y}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					design->select(module, cell);
-					continue;
-				}
-				if (c->type.in(ID(MUX), ID(NMUX))) {
-					RTLIL::Cell *cell = module->addCell(remap_name(c->name), stringf("$_%s_", c->type.c_str()+1));
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::A, ID::B, ID::S, ID::Y}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					design->select(module, cell);
-					continue;
-				}
-				if (c->type == ID(MUX4)) {
-					RTLIL::Cell *cell = module->addCell(remap_name(c->name), ID($_MUX4_));
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::A, ID::B, ID::C, ID::D, ID::S, ID::T, ID::Y}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					design->select(module, cell);
-					continue;
-				}
-				if (c->type == ID(MUX8)) {
-					RTLIL::Cell *cell = module->addCell(remap_name(c->name), ID($_MUX8_));
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::A, ID::B, ID::C, ID::D, ID::E, ID::F, ID::G, ID::H, ID::S, ID::T, ID::U, ID::Y}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					design->select(module, cell);
-					continue;
-				}
-				if (c->type == ID(MUX16)) {
-					RTLIL::Cell *cell = module->addCell(remap_name(c->name), ID($_MUX16_));
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::A, ID::B, ID::C, ID::D, ID::E, ID::F, ID::G, ID::H, ID::I, ID::J, ID::K,
-							ID::L, ID::M, ID::N, ID::O, ID::P, ID::S, ID::T, ID::U, ID::V, ID::Y}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					design->select(module, cell);
-					continue;
-				}
-				if (c->type.in(ID(AOI3), ID(OAI3))) {
-					RTLIL::Cell *cell = module->addCell(remap_name(c->name), stringf("$_%s_", c->type.c_str()+1));
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::A, ID::B, ID::C, ID::Y}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					design->select(module, cell);
-					continue;
-				}
-				if (c->type.in(ID(AOI4), ID(OAI4))) {
-					RTLIL::Cell *cell = module->addCell(remap_name(c->name), stringf("$_%s_", c->type.c_str()+1));
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::A, ID::B, ID::C, ID::D, ID::Y}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					design->select(module, cell);
-					continue;
-				}
-				if (c->type == ID(DFF)) {
-					log_assert(clk_sig.size() == 1);
-					RTLIL::Cell *cell;
-					if (en_sig.size() == 0) {
-						cell = module->addCell(remap_name(c->name), clk_polarity ? ID($_DFF_P_) : ID($_DFF_N_));
-					} else {
-						log_assert(en_sig.size() == 1);
-						cell = module->addCell(remap_name(c->name), stringf("$_DFFE_%c%c_", clk_polarity ? 'P' : 'N', en_polarity ? 'P' : 'N'));
-						cell->setPort(ID::E, en_sig);
-					}
-					if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-					for (auto name : {ID::D, ID::Q}) {
-						RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-						cell->setPort(name, module->wire(remapped_name));
-					}
-					cell->setPort(ID::C, clk_sig);
-					design->select(module, cell);
-					continue;
-				}
-			}
-			else
-				cell_stats[RTLIL::unescape_id(c->type)]++;
+	void set(std::string &&text)
+	{
+		buffer = std::move(text);
+		data = buffer.data();
+		size = buffer.size();
+	}
 
-			if (c->type.in(ID(_const0_), ID(_const1_))) {
-				RTLIL::SigSig conn;
-				conn.first = module->wire(remap_name(c->connections().begin()->second.as_wire()->name));
-				conn.second = RTLIL::SigSpec(c->type == ID(_const0_) ? 0 : 1, 1);
-				module->connect(conn);
-				continue;
+	bool open(const std::string &filename)
+	{
+#ifndef _WIN32
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				mapped = p;
+				data = static_cast<const char*>(p);
+				size = st.st_size;
 			}
+		}
+		::close(fd);
+		if (mapped != nullptr)
+			return true;
+#endif
+		std::ifstream f(filename, std::ios::binary);
+		if (f.fail())
+			return false;
+		std::stringstream text;
+		text << f.rdbuf();
+		set(text.str());
+		return true;
+	}
 
-			if (c->type == ID(_dff_)) {
-				log_assert(clk_sig.size() == 1);
-				RTLIL::Cell *cell;
-				if (en_sig.size() == 0) {
-					cell = module->addCell(remap_name(c->name), clk_polarity ? ID($_DFF_P_) : ID($_DFF_N_));
-				} else {
-					log_assert(en_sig.size() == 1);
-					cell = module->addCell(remap_name(c->name), stringf("$_DFFE_%c%c_", clk_polarity ? 'P' : 'N', en_polarity ? 'P' : 'N'));
-					cell->setPort(ID::E, en_sig);
-				}
-				if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-				for (auto name : {ID::D, ID::Q}) {
-					RTLIL::IdString remapped_name = remap_name(c->getPort(name).as_wire()->name);
-					cell->setPort(name, module->wire(remapped_name));
-				}
-				cell->setPort(ID::C, clk_sig);
-				design->select(module, cell);
-				continue;
-			}
+	// A gzipped file (-compress), decompressed as it is read
+	bool open_gz(const std::string &filename)
+	{
+#ifdef YOSYS_ENABLE_ZLIB
+		gzFile f = gzopen(filename.c_str(), "rb");
+		if (f == nullptr)
+			return false;
+		std::string text;
+		char buf[1 << 16];
+		int n;
+		while ((n = gzread(f, buf, sizeof(buf))) > 0)
+			text.append(buf, n);
+		gzclose(f);
+		if (n < 0)
+			return false;
+		set(std::move(text));
+		return true;
+#else
+		return false;
+#endif
+	}
+};
 
-			if (c->type == ID($lut) && GetSize(c->getPort(ID::A)) == 1 && c->getParam(ID::LUT).as_int() == 2) {
-				SigSpec my_a = module->wire(remap_name(c->getPort(ID::A).as_wire()->name));
-				SigSpec my_y = module->wire(remap_name(c->getPort(ID::Y).as_wire()->name));
-				module->connect(my_y, my_a);
-				continue;
-			}
+// A bump allocator for the transient structures of one domain. It hands out
+// memory from blocks that double in size, and frees nothing until it goes
+// away, then all blocks are released at once. This keeps the millions of
+// small hash nodes of a large domain from fragmenting the heap.
+struct orlo_arena_t
+{
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char *next = nullptr, *end = nullptr;
+	size_t block_size = 64 << 10;
 
-			RTLIL::Cell *cell = module->addCell(remap_name(c->name), c->type);
-			if (markgroups) cell->attributes[ID::abcgroup] = map_autoidx;
-			cell->parameters = c->parameters;
-			for (auto &conn : c->connections()) {
-				RTLIL::SigSpec newsig;
-				for (auto &c : conn.second.chunks()) {
-					if (c.width == 0)
-						continue;
-					log_assert(c.width == 1);
-					newsig.append(module->wire(remap_name(c.wire->name)));
-				}
-				cell->setPort(conn.first, newsig);
-			}
-			design->select(module, cell);
-		}
+	orlo_arena_t() { }
+	orlo_arena_t(const orlo_arena_t&) = delete;
+	orlo_arena_t &operator=(const orlo_arena_t&) = delete;
 
-		for (auto conn : mapped_mod->connections()) {
-			if (!conn.first.is_fully_const())
-				conn.first = module->wire(remap_name(conn.first.as_wire()->name));
-			if (!conn.second.is_fully_const())
-				conn.second = module->wire(remap_name(conn.second.as_wire()->name));
-			module->connect(conn);
+	void *allocate(size_t size, size_t align)
+	{
+		uintptr_t p = (reinterpret_cast<uintptr_t>(next) + align - 1) & ~uintptr_t(align - 1);
+		if (next == nullptr || p + size > reinterpret_cast<uintptr_t>(end)) {
+			size_t n = std::max(block_size, size + align);
+			blocks.emplace_back(new char[n]);
+			next = blocks.back().get();
+			end = next + n;
+			block_size = std::min(2 * block_size, size_t(16) << 20);
+			p = (reinterpret_cast<uintptr_t>(next) + align - 1) & ~uintptr_t(align - 1);
 		}
+		next = reinterpret_cast<char*>(p + size);
+		return reinterpret_cast<void*>(p);
+	}
+};
 
-		if (recover_init)
-			for (auto wire : mapped_mod->wires()) {
-				if (wire->attributes.count(ID::init)) {
-					Wire *w = module->wire(remap_name(wire->name));
-					log_assert(w->attributes.count(ID::init) == 0);
-					w->attributes[ID::init] = wire->attributes.at(ID::init);
-				}
-			}
+// The allocator for containers in an orlo_arena_t. Freeing is left to the
+// arena, so the containers must not outlive it.
+template<typename T>
+struct orlo_arena_allocator_t
+{
+	typedef T value_type;
+	orlo_arena_t *arena;
 
-		for (auto &it : cell_stats)
-			log("ABC RESULTS:   %15s cells: %8d\n", it.first.c_str(), it.second);
-		int in_wires = 0, out_wires = 0;
-		for (auto &si : signal_list)
-			if (si.is_port) {
-				char buffer[100];
-				snprintf(buffer, 100, "\\ys__n%d", si.id);
-				RTLIL::SigSig conn;
-				if (si.type != G(NONE)) {
-					conn.first = si.bit;
-					conn.second = module->wire(remap_name(buffer));
-					out_wires++;
-				} else {
-					conn.first = module->wire(remap_name(buffer));
-					conn.second = si.bit;
-					in_wires++;
-				}
-				module->connect(conn);
-			}
-		log("ABC RESULTS:        internal signals: %8d\n", int(signal_list.size()) - in_wires - out_wires);
-		log("ABC RESULTS:           input signals: %8d\n", in_wires);
-		log("ABC RESULTS:          output signals: %8d\n", out_wires);
+	orlo_arena_allocator_t(orlo_arena_t *arena) : arena(arena) { }
+	template<typename U>
+	orlo_arena_allocator_t(const orlo_arena_allocator_t<U> &other) : arena(other.arena) { }
 
-		delete mapped_design;
+	T *allocate(size_t n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) { }
 
-}
+	template<typename U>
+	bool operator==(const orlo_arena_allocator_t<U> &other) const { return arena == other.arena; }
+	template<typename U>
+	bool operator!=(const orlo_arena_allocator_t<U> &other) const { return arena != other.arena; }
+};
 
-std::string orlo_module2name(RTLIL::Module *module, std::string topdir_name, int clk_domain)
+// Reads ABC's output.blif and creates the mapped logic directly in the module
+// of the job, in a single pass over the text. This understands the subset of
+// BLIF that ABC writes: .inputs/.outputs, .gate/.subckt, unclocked .latch
+// and .names covers, which become $lut or (with -sop) $sop cells like in
+// parse_blif(). Every net is created and remapped once; ys__n<id> nets are
+// looked up by their id.
+struct orlo_blif_reader_t
 {
-	// include module name in temp dir
-	std::string modname = module->name.c_str();
-	// remove problematic characters
-	modname = std::regex_replace(modname, orlo_badchars, "-");
+	struct token_t
+	{
+		const char *p;
+		int len;
+		std::string str() const { return std::string(p, len); }
+		bool operator==(const char *s) const { return int(strlen(s)) == len && strncmp(p, s, len) == 0; }
+		bool operator==(const token_t &other) const { return len == other.len && memcmp(p, other.p, len) == 0; }
+	};
+
+	// A line of output.blif, the continued lines joined, and without the
+	// comment: toks[first] to toks[first+count-1]
+	struct line_t
+	{
+		int first, count, line_nr;
+	};
 
-    // After the regexp replace, we can have a variable number of leading '-', which we will skip
-    size_t idx;
-    for (idx = 0; modname[idx] == '-' && idx < modname.length(); idx++) ;
+	// The tokens point into the text of output.blif, which outlives the
+	// reader, so they can be used as keys without copying them.
+	struct token_hash_t
+	{
+		size_t operator()(const token_t &tok) const
+		{
+			size_t h = 2166136261u;
+			for (int i = 0; i < tok.len; i++)
+				h = (h ^ (unsigned char)tok.p[i]) * 16777619u;
+			return h;
+		}
+	};
 
-    // Can only have up to 100 clock domains.
-	std::string tempdir_name = topdir_name + "/" + modname.substr(idx, 252) + "_" + std::to_string(clk_domain);
-	return tempdir_name;
-}
+	struct cell_type_t
+	{
+		enum kind_t { CELL, CONST0, CONST1, BUF } kind;
+		RTLIL::IdString type;
+		int *count;
+	};
+
+	// The maps by token live in the arena of the reader, which releases
+	// them in one go once the domain is reintegrated.
+	template<typename T>
+	using token_map_t = std::unordered_map<token_t, T, token_hash_t, std::equal_to<token_t>,
+			orlo_arena_allocator_t<std::pair<const token_t, T>>>;
+
+	RTLIL::Design *design;
+	orlo_job_t &job;
+	bool builtin_lib, sop_mode;
+	std::vector<RTLIL::Wire*> signal_wires;
+	orlo_arena_t arena;
+	token_map_t<RTLIL::Wire*> net_wires;
+	token_map_t<RTLIL::IdString> pin_names;
+	token_map_t<cell_type_t> cell_types;
+	std::vector<std::pair<RTLIL::IdString, RTLIL::Wire*>> pins;
+	std::map<std::string, int> cell_stats;
+	int line_nr = 0;
+
+	// The .names block that is being read
+	bool in_names = false;
+	std::vector<RTLIL::Wire*> names_sig;
+	std::vector<RTLIL::State> names_table;
+	RTLIL::State names_default = RTLIL::State::Sx;
+	int names_depth = 0, names_onset = -1;
+
+	orlo_blif_reader_t(RTLIL::Design *design, orlo_job_t &job, bool builtin_lib, bool sop_mode) :
+			design(design), job(job), builtin_lib(builtin_lib), sop_mode(sop_mode),
+			signal_wires(job.signal_list.size()),
+			net_wires(0, token_hash_t(), std::equal_to<token_t>(), &arena),
+			pin_names(0, token_hash_t(), std::equal_to<token_t>(), &arena),
+			cell_types(0, token_hash_t(), std::equal_to<token_t>(), &arena) { }
+
+	void syntax_error()
+	{
+		log_error("Syntax error in line %d of the ABC output.\n", line_nr);
+	}
 
-void orlo_module(RTLIL::Design *design, RTLIL::Module *current_module, std::string script_file, std::string exe_file,
-		std::vector<std::string> &liberty_files, std::vector<std::string> &genlib_files, std::string constr_file,
-		bool cleanup, vector<int> lut_costs, bool dff_mode, std::string clk_str, bool keepff, std::string delay_target,
-		std::string sop_inputs, std::string sop_products, std::string lutin_shared, bool fast_mode,
-        const std::vector<RTLIL::Cell*> &cells, bool show_tempdir, bool sop_mode, bool abc_dress,
-        std::string topdir_name, int clk_domain)
-{
-	module = current_module;
-	map_autoidx = autoidx++;
+	RTLIL::Wire *net(const token_t &tok)
+	{
+		int id = -1;
+		if (tok.len > 5 && strncmp(tok.p, "ys__n", 5) == 0) {
+			id = 0;
+			for (int i = 5; i < tok.len && id >= 0; i++)
+				id = std::isdigit(tok.p[i]) && id < GetSize(signal_wires) ? 10*id + (tok.p[i] - '0') : -1;
+			if (id >= GetSize(signal_wires))
+				id = -1;
+			if (id >= 0 && signal_wires[id] != nullptr)
+				return signal_wires[id];
+		}
 
-	signal_map.clear();
-	signal_list.clear();
-	pi_map.clear();
-	po_map.clear();
-	recover_init = false;
+		RTLIL::Wire *&wire = id >= 0 ? signal_wires[id] : net_wires[tok];
+		if (wire == nullptr)
+			wire = add_wire(RTLIL::escape_id(tok.str()));
+		return wire;
+	}
 
-	if (clk_str != "$")
+	RTLIL::Wire *add_wire(const std::string &abc_name)
 	{
-		clk_polarity = true;
-		clk_sig = RTLIL::SigSpec();
+		RTLIL::Wire *orig_wire = nullptr;
+		RTLIL::Wire *wire = job.module->addWire(remap_net_name(job, abc_name, &orig_wire));
+		if (orig_wire != nullptr && orig_wire->attributes.count(ID::src))
+			wire->attributes[ID::src] = orig_wire->attributes[ID::src];
+		if (markgroups) wire->attributes[ID::abcgroup] = job.map_autoidx;
+		design->select(job.module, wire);
+		return wire;
+	}
 
-		en_polarity = true;
-		en_sig = RTLIL::SigSpec();
+	RTLIL::Cell *add_cell(RTLIL::IdString type, const std::string &stats_name)
+	{
+		cell_stats[stats_name]++;
+		return add_cell(type);
 	}
 
-	if (!clk_str.empty() && clk_str != "$")
+	RTLIL::Cell *add_cell(RTLIL::IdString type)
 	{
-		if (clk_str.find(',') != std::string::npos) {
-			int pos = clk_str.find(',');
-			std::string en_str = clk_str.substr(pos+1);
-			clk_str = clk_str.substr(0, pos);
-			if (en_str[0] == '!') {
-				en_polarity = false;
-				en_str = en_str.substr(1);
+		RTLIL::Cell *cell = job.module->addCell(remap_name(job, NEW_ID), type);
+		if (markgroups) cell->attributes[ID::abcgroup] = job.map_autoidx;
+		design->select(job.module, cell);
+		return cell;
+	}
+
+	// A flip-flop in the clock domain of the job
+	void add_dff(RTLIL::Wire *d, RTLIL::Wire *q)
+	{
+		log_assert(job.clk_sig.size() == 1);
+		RTLIL::Cell *cell;
+		std::string stats_name = builtin_lib ? "DFF" : "_dff_";
+		if (job.en_sig.size() == 0) {
+			cell = add_cell(job.clk_polarity ? ID($_DFF_P_) : ID($_DFF_N_), stats_name);
+		} else {
+			log_assert(job.en_sig.size() == 1);
+			cell = add_cell(stringf("$_DFFE_%c%c_", job.clk_polarity ? 'P' : 'N', job.en_polarity ? 'P' : 'N'), stats_name);
+			cell->setPort(ID::E, job.en_sig);
+		}
+		cell->setPort(ID::D, d);
+		cell->setPort(ID::Q, q);
+		cell->setPort(ID::C, job.clk_sig);
+	}
+
+	void latch(const std::vector<token_t> &toks)
+	{
+		// .latch <d> <q> [<init>], ABC does not write clocked latches for
+		// the netlists it gets from us.
+		if (toks.size() < 3 || toks.size() > 4)
+			syntax_error();
+		RTLIL::Wire *d = net(toks[1]), *q = net(toks[2]);
+		if (toks.size() == 4 && job.recover_init && (toks[3] == "0" || toks[3] == "1")) {
+			log_assert(q->attributes.count(ID::init) == 0);
+			q->attributes[ID::init] = Const(toks[3] == "1" ? 1 : 0, 1);
+		}
+		add_dff(d, q);
+	}
+
+	const RTLIL::IdString &pin_name(const token_t &tok)
+	{
+		auto it = pin_names.find(tok);
+		if (it == pin_names.end())
+			it = pin_names.insert(std::make_pair(tok, RTLIL::IdString(RTLIL::escape_id(tok.str())))).first;
+		return it->second;
+	}
+
+	// What a .gate/.subckt type turns into, resolved once per type
+	const cell_type_t &cell_type(const token_t &tok)
+	{
+		auto it = cell_types.find(tok);
+		if (it != cell_types.end())
+			return it->second;
+
+		static const pool<std::string> builtin_types = {
+			"NOT", "AND", "OR", "XOR", "NAND", "NOR", "XNOR", "ANDNOT", "ORNOT",
+			"MUX", "NMUX", "MUX4", "MUX8", "MUX16", "AOI3", "OAI3", "AOI4", "OAI4"
+		};
+
+		std::string type = tok.str();
+		cell_type_t info;
+		info.kind = cell_type_t::CELL;
+		info.type = RTLIL::escape_id(type);
+		info.count = &cell_stats[type];
+		if (builtin_lib && (type == "ZERO" || type == "ONE"))
+			info.kind = type == "ZERO" ? cell_type_t::CONST0 : cell_type_t::CONST1;
+		else if (builtin_lib && type == "BUF")
+			info.kind = cell_type_t::BUF;
+		else if (builtin_lib && builtin_types.count(type))
+			info.type = stringf("$_%s_", type.c_str());
+		else if (type == "_const0_" || type == "_const1_")
+			info.kind = type == "_const0_" ? cell_type_t::CONST0 : cell_type_t::CONST1;
+		return cell_types.insert(std::make_pair(tok, info)).first->second;
+	}
+
+	RTLIL::Wire *pin(RTLIL::IdString name) const
+	{
+		for (auto &it : pins)
+			if (it.first == name)
+				return it.second;
+		return nullptr;
+	}
+
+	void gate(const std::vector<token_t> &toks)
+	{
+		if (toks.size() < 2)
+			syntax_error();
+		const cell_type_t &type = cell_type(toks[1]);
+
+		pins.clear();
+		for (size_t i = 2; i < toks.size(); i++) {
+			const char *eq = static_cast<const char*>(memchr(toks[i].p, '=', toks[i].len));
+			if (eq == nullptr)
+				syntax_error();
+			token_t pin = { toks[i].p, int(eq - toks[i].p) };
+			token_t conn = { eq + 1, int(toks[i].len - (eq + 1 - toks[i].p)) };
+			pins.push_back(std::make_pair(pin_name(pin), conn.len > 0 ? net(conn) : nullptr));
+		}
+
+		(*type.count)++;
+		switch (type.kind)
+		{
+		case cell_type_t::CONST0:
+		case cell_type_t::CONST1:
+			// ZERO/ONE drive Y, _const0_/_const1_ their only pin
+			if (!pins.empty())
+				job.module->connect(builtin_lib && type.type.in(ID(ZERO), ID(ONE)) ? pin(ID::Y) : pins.front().second,
+						RTLIL::SigSpec(type.kind == cell_type_t::CONST0 ? 0 : 1, 1));
+			return;
+		case cell_type_t::BUF:
+			job.module->connect(pin(ID::Y), pin(ID::A));
+			return;
+		case cell_type_t::CELL:
+			break;
+		}
+
+		RTLIL::Cell *cell = add_cell(type.type);
+		for (auto &it : pins)
+			cell->setPort(it.first, it.second == nullptr ? RTLIL::SigSpec() : RTLIL::SigSpec(it.second));
+	}
+
+	void names(const std::vector<token_t> &toks)
+	{
+		if (toks.size() < 2)
+			syntax_error();
+		in_names = true;
+		names_sig.clear();
+		for (size_t i = 1; i < toks.size(); i++)
+			names_sig.push_back(net(toks[i]));
+		int width = GetSize(names_sig) - 1;
+		names_table.clear();
+		if (width > 0 && !sop_mode) {
+			// The truth table of a $lut, as wide as ABC made it
+			if (width >= 31)
+				log_error("The cover in line %d of the ABC output has %d inputs, too many for a $lut.\n", line_nr, width);
+			names_table.resize(size_t(1) << width, RTLIL::State::Sx);
+		}
+		names_default = RTLIL::State::Sx;
+		names_depth = 0;
+		names_onset = -1;
+	}
+
+	void names_row(const std::vector<token_t> &toks)
+	{
+		int width = GetSize(names_sig) - 1;
+
+		if (width == 0) {
+			// A constant, any 1 makes it a constant 1
+			for (auto &tok : toks)
+				if (memchr(tok.p, '1', tok.len) != nullptr)
+					names_default = RTLIL::State::S1;
+			return;
+		}
+
+		if (toks.size() != 2 || toks[0].len != width || !(toks[1] == "0" || toks[1] == "1"))
+			syntax_error();
+		const char *input = toks[0].p;
+		bool output = toks[1] == "1";
+
+		if (sop_mode) {
+			names_depth++;
+			for (int i = 0; i < width; i++) {
+				names_table.push_back(input[i] == '0' ? RTLIL::State::S1 : RTLIL::State::S0);
+				names_table.push_back(input[i] == '1' ? RTLIL::State::S1 : RTLIL::State::S0);
 			}
-			if (module->wire(RTLIL::escape_id(en_str)) != nullptr)
-				en_sig = assign_map(module->wire(RTLIL::escape_id(en_str)));
+			if (names_onset < 0)
+				names_onset = output;
+			else if (names_onset != output)
+				syntax_error();
+			return;
 		}
-		if (clk_str[0] == '!') {
-			clk_polarity = false;
-			clk_str = clk_str.substr(1);
+
+		for (int i = 0; i < (1 << width); i++) {
+			bool match = true;
+			for (int j = 0; j < width && match; j++)
+				if (input[j] != '-' && input[j] != ((i & (1 << j)) != 0 ? '1' : '0'))
+					match = false;
+			if (match)
+				names_table[i] = output ? RTLIL::State::S1 : RTLIL::State::S0;
 		}
-		if (module->wire(RTLIL::escape_id(clk_str)) != nullptr)
-			clk_sig = assign_map(module->wire(RTLIL::escape_id(clk_str)));
+		names_default = output ? RTLIL::State::S0 : RTLIL::State::S1;
 	}
 
-	if (dff_mode && clk_sig.empty())
-		log_cmd_error("Clock domain %s not found.\n", clk_str.c_str());
+	void finish_names()
+	{
+		if (!in_names)
+			return;
+		in_names = false;
 
-	//std::string tempdir_name = "/tmp/" + proc_program_prefix()+ "yosys-abc-XXXXXX";
-	std::string tempdir_name = orlo_module2name(module, topdir_name, clk_domain);
-	//if (!cleanup)
-	//	tempdir_name[0] = tempdir_name[4] = '_';
-    
-	//tempdir_name = make_temp_dir(tempdir_name);
+		int width = GetSize(names_sig) - 1;
+		RTLIL::Wire *output = names_sig.back();
+		RTLIL::SigSpec inputs;
+		for (int i = 0; i < width; i++)
+			inputs.append(names_sig[i]);
 
-	if (mkdir(tempdir_name.c_str(), 0777) != 0) {
-		log_cmd_error("Could not create %s directory.\n", tempdir_name.c_str());
+		if (width == 0) {
+			job.module->connect(output, RTLIL::SigSpec(names_default == RTLIL::State::S1 ? 1 : 0, 1));
+			return;
+		}
+
+		if (sop_mode) {
+			RTLIL::Cell *cell = add_cell(ID($sop), "$sop");
+			cell->parameters[ID::WIDTH] = RTLIL::Const(width);
+			cell->parameters[ID::DEPTH] = RTLIL::Const(names_depth);
+			cell->parameters[ID::TABLE] = RTLIL::Const(names_table);
+			cell->setPort(ID::A, inputs);
+			if (names_onset == 0) {
+				// An off-set cover, the $sop drives an inverter
+				RTLIL::Wire *tempnet = add_wire(NEW_ID.str());
+				RTLIL::Cell *inv = add_cell(ID($_NOT_), "$_NOT_");
+				inv->setPort(ID::A, tempnet);
+				inv->setPort(ID::Y, output);
+				output = tempnet;
+			}
+			cell->setPort(ID::Y, output);
+			return;
+		}
+
+		for (auto &bit : names_table)
+			if (bit == RTLIL::State::Sx)
+				bit = names_default;
+		RTLIL::Const lut(names_table);
+		if (width == 1 && lut.as_int() == 2) {
+			cell_stats["$lut"]++;
+			job.module->connect(output, inputs);
+			return;
+		}
+		RTLIL::Cell *cell = add_cell(ID($lut), "$lut");
+		cell->parameters[ID::WIDTH] = RTLIL::Const(width);
+		cell->parameters[ID::LUT] = lut;
+		cell->setPort(ID::A, inputs);
+		cell->setPort(ID::Y, output);
 	}
-    
-	log_header(design, "Extracting gate netlist of module `%s' to `%s/input.blif'..\n",
-			module->name.c_str(), replace_tempdir(tempdir_name, tempdir_name, show_tempdir).c_str());
 
-	std::string abc_script = stringf("read_blif %s/input.blif; ", tempdir_name.c_str());
+	// Split the text into lines of tokens. This does not touch the design
+	// or the log, so it can run on a worker thread.
+	static void tokenize(const char *p, const char *end, std::vector<token_t> &toks, std::vector<line_t> &lines)
+	{
+		bool continued = false;
+		int line_nr = 0;
+
+		while (p < end)
+		{
+			const char *eol = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (eol == nullptr)
+				eol = end;
+			line_nr++;
+
+			// A trailing backslash continues the line and a '#' starts a
+			// comment.
+			if (!continued)
+				lines.push_back(line_t{ GetSize(toks), 0, line_nr });
+			size_t first_tok = toks.size();
+			const char *q = p;
+			while (q < eol) {
+				while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r'))
+					q++;
+				if (q == eol || *q == '#')
+					break;
+				const char *start = q;
+				while (q < eol && *q != ' ' && *q != '\t' && *q != '\r')
+					q++;
+				toks.push_back(token_t{ start, int(q - start) });
+			}
+			continued = toks.size() > first_tok && toks.back().p[toks.back().len-1] == '\\';
+			if (continued && --toks.back().len == 0)
+				toks.pop_back();
+			p = eol + 1;
+			lines.back().count = GetSize(toks) - lines.back().first;
+			lines.back().line_nr = line_nr;
+			if (!continued && lines.back().count == 0)
+				lines.pop_back();
+		}
+		// Like a line that is still continued at the end of the file
+		if (continued)
+			lines.pop_back();
+	}
 
-	if (!liberty_files.empty() || !genlib_files.empty()) {
-		for (std::string liberty_file : liberty_files)
-			abc_script += stringf("read_lib -w %s; ", liberty_file.c_str());
-		for (std::string liberty_file : genlib_files)
-			abc_script += stringf("read_library %s; ", liberty_file.c_str());
-		if (!constr_file.empty())
-			abc_script += stringf("read_constr -v %s; ", constr_file.c_str());
-	} else
-	if (!lut_costs.empty())
-		abc_script += stringf("read_lut %s/lutdefs.txt; ", tempdir_name.c_str());
-	else
-		abc_script += stringf("read_library %s/stdcells.genlib; ", tempdir_name.c_str());
+	void read(const std::vector<token_t> &all_toks, const std::vector<line_t> &lines)
+	{
+		std::vector<token_t> toks;
+		bool found_model = false;
+
+		for (auto &line : lines)
+		{
+			line_nr = line.line_nr;
+			toks.assign(all_toks.begin() + line.first, all_toks.begin() + line.first + line.count);
+
+			if (toks[0].p[0] != '.') {
+				if (!in_names)
+					syntax_error();
+				names_row(toks);
+				continue;
+			}
+
+			finish_names();
+
+			if (toks[0] == ".model") {
+				if (found_model || toks.size() != 2 || !(toks[1] == "netlist"))
+					log_error("ABC output file does not contain a module `netlist'.\n");
+				found_model = true;
+			} else if (toks[0] == ".inputs" || toks[0] == ".outputs") {
+				for (size_t i = 1; i < toks.size(); i++)
+					net(toks[i]);
+			} else if (toks[0] == ".names") {
+				names(toks);
+			} else if (toks[0] == ".gate" || toks[0] == ".subckt") {
+				gate(toks);
+			} else if (toks[0] == ".latch") {
+				latch(toks);
+			} else if (toks[0] == ".end") {
+				break;
+			} else if (toks[0].len > 9 && strncmp(toks[0].p, ".default_", 9) == 0) {
+				// timing information
+			} else
+				syntax_error();
+		}
+		finish_names();
+
+		if (!found_model)
+			log_error("ABC output file does not contain a module `netlist'.\n");
+	}
+};
+
+// ABC's output of a job, loaded and split into tokens, ready to be read
+// into the module.
+struct orlo_blif_output_t
+{
+	orlo_blif_text_t text;
+	std::vector<orlo_blif_reader_t::token_t> toks;
+	std::vector<orlo_blif_reader_t::line_t> lines;
+	// Why there is nothing to reintegrate, or why loading failed
+	std::string missing, error;
+
+	void clear()
+	{
+		text.clear();
+		std::vector<orlo_blif_reader_t::token_t>().swap(toks);
+		std::vector<orlo_blif_reader_t::line_t>().swap(lines);
+	}
+};
+
+// Load the output of a job. This does not touch the design or the log, so
+// orlo_reint -j runs it for all jobs on worker threads.
+void orlo_load_output(orlo_job_t &job, orlo_blif_output_t &output)
+{
+	orlo_phase_timer_t timer;
+	if (job.inmem && !job.cache_hit) {
+		// -inmem: ABC's output.blif was read back into the job
+		if (job.output_text.empty()) {
+			output.missing = "ABC didn't write an output netlist.  Skipping.\n";
+			return;
+		}
+		output.text.set(std::move(job.output_text));
+		job.output_text.clear();
+	} else {
+		if (job.unlisted) {
+			output.missing = stringf("Domain %s is empty, there is no ABC output.  Skipping.\n", job.tempdir_name.c_str());
+			return;
+		}
+		std::string filename = job.output_blif;
+		if (!exists(filename) && exists(filename + ".gz"))
+			filename += ".gz";
+		// Without a manifest (an abc work directory of an older version) an
+		// empty module is found by its missing output.blif.
+		if (!exists(filename)) {
+			output.missing = stringf("ABC file %s doesn't exist.  Skipping.\n", job.output_blif.c_str());
+			return;
+		}
+
+		if (!(is_gz(filename) ? output.text.open_gz(filename) : output.text.open(filename))) {
+			output.error = stringf("Can't open ABC output file `%s'.\n", filename.c_str());
+			return;
+		}
+	}
+	orlo_blif_reader_t::tokenize(output.text.data, output.text.data + output.text.size, output.toks, output.lines);
+	job.phases[ORLO_PHASE_READ_BLIF].add(timer.stop());
+}
+
+// Load the outputs of all jobs, on up to nprocs worker threads.
+void orlo_load_outputs(std::deque<orlo_job_t> &jobs, size_t first, size_t last, std::vector<orlo_blif_output_t> &outputs,
+		int nprocs)
+{
+	int count = int(last - first);
+	nprocs = std::min(nprocs, count);
+	if (nprocs <= 1) {
+		for (int i = 0; i < count; i++)
+			orlo_load_output(jobs[first + i], outputs[i]);
+		return;
+	}
+
+	log("Loading %d ABC outputs on %d worker threads.\n", count, nprocs);
+	log_flush();
+
+	std::atomic<int> next_job(0);
+	std::vector<std::thread> workers;
+	for (int i = 0; i < nprocs; i++)
+		workers.emplace_back([&]() {
+			for (int idx = next_job++; idx < count; idx = next_job++)
+				orlo_load_output(jobs[first + idx], outputs[idx]);
+		});
+	for (auto &worker : workers)
+		worker.join();
+}
+
+void orlo_reintegrate(RTLIL::Design *design,
+                     orlo_job_t &job,
+                     orlo_blif_output_t &output,
+                     const std::vector<std::string> &liberty_files,
+                     const std::vector<std::string> &genlib_files,
+                     bool sop_mode)
+{
+	if (!output.error.empty())
+		log_error("%s", output.error.c_str());
+	if (!output.missing.empty()) {
+		log("%s", output.missing.c_str());
+		return;
+	}
+
+		bool builtin_lib = liberty_files.empty() && genlib_files.empty();
+
+		log_header(design, "Re-integrating ABC results.\n");
+		orlo_phase_timer_t read_timer;
+		orlo_blif_reader_t reader(design, job, builtin_lib, sop_mode);
+		reader.read(output.toks, output.lines);
+		job.phases[ORLO_PHASE_READ_BLIF].add(read_timer.stop());
+
+		orlo_phase_timer_t reintegrate_timer;
+		std::map<std::string, int> &cell_stats = reader.cell_stats;
+
+		for (auto &it : cell_stats)
+			log("ABC RESULTS:   %15s cells: %8d\n", it.first.c_str(), it.second);
+		int in_wires = 0, out_wires = 0;
+		for (auto &si : job.signal_list)
+			if (si.is_port) {
+				RTLIL::Wire *wire = reader.signal_wires[si.id];
+				if (wire == nullptr) {
+					char buffer[100];
+					snprintf(buffer, 100, "\\ys__n%d", si.id);
+					wire = job.module->wire(remap_name(job, buffer));
+				}
+				RTLIL::SigSig conn;
+				if (si.type != G(NONE)) {
+					conn.first = job.signal_bits[si.id].bit;
+					conn.second = wire;
+					out_wires++;
+				} else {
+					conn.first = wire;
+					conn.second = job.signal_bits[si.id].bit;
+					in_wires++;
+				}
+				job.module->connect(conn);
+			}
+		log("ABC RESULTS:        internal signals: %8d\n", int(job.signal_list.size()) - in_wires - out_wires);
+		log("ABC RESULTS:           input signals: %8d\n", in_wires);
+		log("ABC RESULTS:          output signals: %8d\n", out_wires);
+		job.phases[ORLO_PHASE_REINTEGRATE].add(reintegrate_timer.stop());
+}
+
+// Same as log_signal() for a single bit, but without the shared string
+// buffers of the log, so that it can be used on the worker threads.
+std::string orlo_signal_name(const RTLIL::SigBit &bit)
+{
+	if (bit.wire == nullptr)
+		return bit == State::S0 ? "1'0" : bit == State::S1 ? "1'1" : "1'x";
+	if (bit.wire->width == 1)
+		return bit.wire->name.c_str();
+	return stringf("%s [%d]", bit.wire->name.c_str(), bit.offset);
+}
+
+// The .names cover of each gate type in input.blif, indexed by gate_type_t.
+// NONE has no cover of its own and FF is written as a .latch.
+struct orlo_blif_cover_t
+{
+	int inputs;
+	const char *rows;
+};
+
+constexpr orlo_blif_cover_t orlo_blif_covers[] = {
+	{ 0, nullptr },                          // NONE
+	{ 1, nullptr },                          // FF
+	{ 1, "1 1\n" },                          // BUF
+	{ 1, "0 1\n" },                          // NOT
+	{ 2, "11 1\n" },                         // AND
+	{ 2, "0- 1\n-0 1\n" },                   // NAND
+	{ 2, "-1 1\n1- 1\n" },                   // OR
+	{ 2, "00 1\n" },                         // NOR
+	{ 2, "01 1\n10 1\n" },                   // XOR
+	{ 2, "00 1\n11 1\n" },                   // XNOR
+	{ 2, "10 1\n" },                         // ANDNOT
+	{ 2, "1- 1\n-0 1\n" },                   // ORNOT
+	{ 3, "1-0 1\n-11 1\n" },                 // MUX
+	{ 3, "0-0 1\n-01 1\n" },                 // NMUX
+	{ 3, "-00 1\n0-0 1\n" },                 // AOI3
+	{ 3, "00- 1\n--0 1\n" },                 // OAI3
+	{ 4, "-0-0 1\n-00- 1\n0--0 1\n0-0- 1\n" }, // AOI4
+	{ 4, "00-- 1\n--00 1\n" },               // OAI4
+};
+
+static_assert(sizeof(orlo_blif_covers) / sizeof(orlo_blif_covers[0]) == int(G(OAI4)) + 1,
+		"orlo_blif_covers must have an entry for every gate_type_t");
+
+// Append " ys__n<id>" without going through printf.
+void orlo_blif_signal(std::string &blif, int id)
+{
+	char digits[16];
+	int n = 0;
+	unsigned int value = id < 0 ? -(unsigned int)id : id;
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+	blif += " ys__n";
+	if (id < 0)
+		blif += '-';
+	while (n > 0)
+		blif += digits[--n];
+}
+
+// Generate the input.blif of a job. This only reads the job, so it can run
+// on the worker threads ahead of the ABC run. The whole netlist is built in
+// one buffer, so it is written with a single stream write.
+std::string orlo_input_blif(const orlo_job_t &job)
+{
+	std::string blif;
+	blif.reserve(64 * job.signal_list.size() + 64);
+
+	blif += ".model netlist\n";
+
+	blif += ".inputs";
+	for (auto &si : job.signal_list) {
+		if (!si.is_port || si.type != G(NONE))
+			continue;
+		orlo_blif_signal(blif, si.id);
+	}
+	if (job.count_input == 0)
+		blif += " dummy_input\n";
+	blif += "\n";
+
+	blif += ".outputs";
+	for (auto &si : job.signal_list) {
+		if (!si.is_port || si.type == G(NONE))
+			continue;
+		orlo_blif_signal(blif, si.id);
+	}
+	blif += "\n";
+
+	blif += job.blif_comments;
+
+	for (auto &si : job.signal_list) {
+		const RTLIL::SigBit &bit = job.signal_bits[si.id].bit;
+		if (bit.wire == nullptr) {
+			blif += ".names";
+			orlo_blif_signal(blif, si.id);
+			blif += "\n";
+			if (bit == RTLIL::State::S1)
+				blif += "1\n";
+		}
+	}
+
+	for (auto &si : job.signal_list) {
+		if (si.type == G(NONE))
+			continue;
+		const orlo_blif_cover_t &cover = orlo_blif_covers[int(si.type)];
+		const int inputs[4] = { si.in1, si.in2, si.in3, si.in4 };
+
+		if (si.type == G(FF)) {
+			RTLIL::State init = job.signal_bits[si.id].init;
+			blif += ".latch";
+			orlo_blif_signal(blif, si.in1);
+			orlo_blif_signal(blif, si.id);
+			blif += init == State::S1 ? " 1\n" : init == State::S0 ? " 0\n" : " 2\n";
+			continue;
+		}
+
+		blif += ".names";
+		for (int i = 0; i < cover.inputs; i++)
+			orlo_blif_signal(blif, inputs[i]);
+		orlo_blif_signal(blif, si.id);
+		blif += "\n";
+		blif += cover.rows;
+	}
+
+	blif += ".end\n";
+	return blif;
+
+}
+
+std::string orlo_module2name(RTLIL::Module *module, std::string topdir_name, int clk_domain)
+{
+	// include module name in temp dir
+	std::string modname = module->name.c_str();
+	// replace problematic characters
+	for (auto &c : modname)
+		if (c == '\'' || c == '$' || c == '\\')
+			c = '-';
+
+	// After the replacement, we can have a variable number of leading '-', which we will skip
+	size_t idx;
+	for (idx = 0; idx < modname.length() && modname[idx] == '-'; idx++)
+		;
+
+	// Can only have up to 100 clock domains.
+	std::string tempdir_name = topdir_name + "/" + modname.substr(idx, 252) + "_" + std::to_string(clk_domain);
+	return tempdir_name;
+}
+
+// The key of a domain in the manifest: the module, the clock and enable
+// signals and the -max_gates part. orlo_reint finds the directory of a
+// domain by it, whatever order the domains are enumerated in.
+std::string orlo_domain_key(const orlo_job_t &job)
+{
+	std::string key = job.module->name.str();
+	if (!job.clk_sig.empty()) {
+		key += stringf(" %s %s", job.clk_polarity ? "posedge" : "negedge", log_signal(job.clk_sig));
+		if (!job.en_sig.empty())
+			key += stringf(" enable %s%s", job.en_polarity ? "" : "!", log_signal(job.en_sig));
+	}
+	key += stringf(" part %d", job.part);
+	for (auto &c : key)
+		if (c == '\t' || c == '\n' || c == '\r')
+			c = ' ';
+	return key;
+}
+
+// signals.bin, what orlo_reint needs of an extraction: for every signal id
+// its wire and bit (or constant), whether it is a port, the gate that
+// drives it and the inputs of that gate, plus the loops that were broken and the names of the
+// extracted cells. All integers are 32 bit in the byte order of the host,
+// names are indices into a string table at the end:
+//
+//   "ORLOSIG2", module name, #signals, #loop breaks, #cells, #names
+//   per signal:     wire name (-1 for a constant), offset or State, type, is_port,
+//                   in1, in2, in3, in4 (-1 if unused)
+//   per loop break: new signal, original signal
+//   per cell:       cell name
+//   #names+1 offsets into the characters that follow
+#define ORLO_MANIFEST_HEADER "# orlo manifest 2"
+#define ORLO_SIGNALS_MAGIC "ORLOSIG2"
+#define ORLO_SIGNAL_FIELDS 8
+
+bool orlo_write_signals(const orlo_job_t &job, const std::string &filename)
+{
+	std::vector<int32_t> data;
+	std::vector<std::string> names;
+	dict<RTLIL::IdString, int> name_ids;
+	auto name = [&](RTLIL::IdString id) -> int {
+		auto it = name_ids.find(id);
+		if (it != name_ids.end())
+			return it->second;
+		names.push_back(id.str());
+		return name_ids[id] = GetSize(names) - 1;
+	};
+
+	data.push_back(name(job.module->name));
+	data.push_back(GetSize(job.signal_list));
+	data.push_back(GetSize(job.loop_breaks));
+	data.push_back(GetSize(job.extracted_cells));
+	data.push_back(0);
+	for (auto &si : job.signal_list) {
+		const RTLIL::SigBit &bit = job.signal_bits[si.id].bit;
+		data.push_back(bit.wire != nullptr ? name(bit.wire->name) : -1);
+		data.push_back(bit.wire != nullptr ? bit.offset : int(bit.data));
+		data.push_back(int(si.type));
+		data.push_back(si.is_port);
+		// -simcheck simulates the extracted logic from these
+		data.push_back(si.in1);
+		data.push_back(si.in2);
+		data.push_back(si.in3);
+		data.push_back(si.in4);
+	}
+	for (auto &it : job.loop_breaks) {
+		data.push_back(it.first);
+		data.push_back(it.second);
+	}
+	for (auto cell : job.extracted_cells)
+		data.push_back(name(cell->name));
+	data[4] = GetSize(names);
+
+	std::string chars;
+	data.push_back(0);
+	for (auto &str : names) {
+		chars += str;
+		data.push_back(GetSize(chars));
+	}
+
+	std::ofstream f(filename, std::ios::binary);
+	f.write(ORLO_SIGNALS_MAGIC, 8);
+	f.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(int32_t));
+	f.write(chars.data(), chars.size());
+	f.close();
+	return !f.fail();
+}
+
+// Read signals.bin into a job of orlo_reint, instead of extracting the
+// domain again. This fails, without changing the job or the module, if the
+// file is missing or does not match the module.
+bool orlo_read_signals(orlo_job_t &job, const std::string &filename)
+{
+	orlo_blif_text_t file;
+	if (!exists(filename) || !file.open(filename) || file.size < 8 + 5 * sizeof(int32_t) ||
+			memcmp(file.data, ORLO_SIGNALS_MAGIC, 8) != 0)
+		return false;
+
+	const char *end = file.data + file.size;
+	const char *p = file.data + 8;
+	bool ok = true;
+	auto next = [&]() -> int32_t {
+		int32_t value = 0;
+		if (p + sizeof(int32_t) <= end)
+			memcpy(&value, p, sizeof(int32_t));
+		else
+			ok = false;
+		p += sizeof(int32_t);
+		return value;
+	};
+
+	int module_name = next(), nsignals = next(), nloops = next(), ncells = next(), nnames = next();
+	if (nsignals < 0 || nloops < 0 || ncells < 0 || nnames < 0 ||
+			size_t(end - p) < (size_t(ORLO_SIGNAL_FIELDS) * nsignals + 2 * nloops + ncells + nnames + 1) * sizeof(int32_t))
+		return false;
+	const char *records = p;
+	p += (size_t(ORLO_SIGNAL_FIELDS) * nsignals + 2 * nloops + ncells) * sizeof(int32_t);
+	std::vector<int32_t> offsets(nnames + 1);
+	for (auto &offset : offsets)
+		offset = next();
+	const char *chars = p;
+	for (int i = 0; i < nnames; i++)
+		if (offsets[i] < 0 || offsets[i] > offsets[i+1] || chars + offsets[i+1] > end)
+			return false;
+	auto str = [&](int idx) {
+		return idx >= 0 && idx < nnames ? std::string(chars + offsets[idx], offsets[idx+1] - offsets[idx]) : std::string();
+	};
+	if (str(module_name) != job.module->name.str())
+		return false;
+
+	// Check everything against the module before anything is changed. The
+	// wires of the loop breaks are created like handle_loops() does.
+	p = records;
+	pool<int> loop_signals;
+	std::vector<int32_t> signal_records(ORLO_SIGNAL_FIELDS * size_t(nsignals));
+	for (auto &value : signal_records)
+		value = next();
+	std::vector<std::pair<int, int>> loop_breaks;
+	for (int i = 0; i < nloops; i++) {
+		int id3 = next(), id1 = next();
+		if (id3 < 0 || id3 >= nsignals || id1 < 0 || id1 >= nsignals)
+			return false;
+		loop_breaks.push_back(std::make_pair(id3, id1));
+		loop_signals.insert(id3);
+	}
+	std::vector<RTLIL::Cell*> cells;
+	for (int i = 0; i < ncells; i++) {
+		RTLIL::Cell *cell = job.module->cell(RTLIL::IdString(str(next())));
+		if (cell == nullptr)
+			return false;
+		cells.push_back(cell);
+	}
+	std::vector<RTLIL::Wire*> wires(nsignals);
+	for (int id = 0; id < nsignals; id++) {
+		const int32_t *record = &signal_records[ORLO_SIGNAL_FIELDS * id];
+		int wire_name = record[0], offset = record[1], type = record[2];
+		if (type < 0 || type > int(G(OAI4)))
+			return false;
+		for (int k = 4; k < 8; k++)
+			if (record[k] < -1 || record[k] >= nsignals)
+				return false;
+		if (loop_signals.count(id) || wire_name < 0)
+			continue;
+		wires[id] = job.module->wire(RTLIL::IdString(str(wire_name)));
+		if (wires[id] == nullptr || offset < 0 || offset >= wires[id]->width)
+			return false;
+	}
+	if (!ok)
+		return false;
+
+	for (int id = 0; id < nsignals; id++) {
+		const int32_t *record = &signal_records[ORLO_SIGNAL_FIELDS * id];
+		gate_t gate;
+		gate.id = id;
+		gate.type = gate_type_t(record[2]);
+		gate.in1 = record[4];
+		gate.in2 = record[5];
+		gate.in3 = record[6];
+		gate.in4 = record[7];
+		gate.is_port = record[3] != 0;
+		RTLIL::SigBit bit;
+		if (loop_signals.count(id))
+			bit = job.module->addWire(stringf("$abcloop$%d", autoidx++));
+		else if (wires[id] != nullptr)
+			bit = RTLIL::SigBit(wires[id], record[1]);
+		else
+			bit = RTLIL::SigBit(RTLIL::State(record[1]));
+		job.signal_list.push_back(gate);
+		job.signal_bits.push_back({bit, RTLIL::State::Sx});
+	}
+	for (auto &it : loop_breaks)
+		job.module->connect(RTLIL::SigSig(job.signal_bits[it.first].bit, job.signal_bits[it.second].bit));
+	job.loop_breaks.swap(loop_breaks);
+	job.extracted_cells.swap(cells);
+	return true;
+}
+
+// The commands that read the libraries given with -liberty, -genlib and
+// -constr. With -abc_pool these are only run once in every ABC process.
+std::vector<std::string> orlo_library_commands(const std::vector<std::string> &liberty_files,
+		const std::vector<std::string> &genlib_files, const std::string &constr_file)
+{
+	std::vector<std::string> commands;
+	for (auto &liberty_file : liberty_files)
+		commands.push_back(stringf("read_lib -w %s", liberty_file.c_str()));
+	for (auto &liberty_file : genlib_files)
+		commands.push_back(stringf("read_library %s", liberty_file.c_str()));
+	if (!constr_file.empty() && (!liberty_files.empty() || !genlib_files.empty()))
+		commands.push_back(stringf("read_constr -v %s", constr_file.c_str()));
+	return commands;
+}
+
+// The ABC commands of a script, after the netlist and the libraries are read:
+// the -script argument or the default script for the target.
+std::string orlo_script_body(const std::string &script_file, bool fast_mode, const std::vector<std::string> &liberty_files,
+		const std::vector<std::string> &genlib_files, const std::string &constr_file, const vector<int> &lut_costs,
+		const std::string &delay_target, bool sop_mode)
+{
+	std::string abc_script;
 
 	if (!script_file.empty()) {
 		if (script_file[0] == '+') {
@@ -1135,288 +2189,2443 @@ void orlo_module(RTLIL::Design *design, RTLIL::Module *current_module, std::stri
 		for (size_t pos = abc_script.find("dretime;"); pos != std::string::npos; pos = abc_script.find("dretime;", pos+1))
 			abc_script = abc_script.substr(0, pos) + "dretime; retime -o {D};" + abc_script.substr(pos+8);
 
-	for (size_t pos = abc_script.find("{D}"); pos != std::string::npos; pos = abc_script.find("{D}", pos))
-		abc_script = abc_script.substr(0, pos) + delay_target + abc_script.substr(pos+3);
-
-	for (size_t pos = abc_script.find("{I}"); pos != std::string::npos; pos = abc_script.find("{D}", pos))
-		abc_script = abc_script.substr(0, pos) + sop_inputs + abc_script.substr(pos+3);
-
-	for (size_t pos = abc_script.find("{P}"); pos != std::string::npos; pos = abc_script.find("{D}", pos))
-		abc_script = abc_script.substr(0, pos) + sop_products + abc_script.substr(pos+3);
-
-	for (size_t pos = abc_script.find("{S}"); pos != std::string::npos; pos = abc_script.find("{S}", pos))
-		abc_script = abc_script.substr(0, pos) + lutin_shared + abc_script.substr(pos+3);
-	if (abc_dress)
-		abc_script += "; dress";
-	abc_script += stringf("; write_blif %s/output.blif", tempdir_name.c_str());
-	abc_script = add_echos_to_abc_cmd(abc_script);
-
-	for (size_t i = 0; i+1 < abc_script.size(); i++)
-		if (abc_script[i] == ';' && abc_script[i+1] == ' ')
-			abc_script[i+1] = '\n';
+	return abc_script;
+}
 
-	std::string buffer = stringf("%s/abc.script", tempdir_name.c_str());
-	FILE *f = fopen(buffer.c_str(), "wt");
-	if (f == nullptr)
-		log_error("Opening %s for writing failed: %s\n", buffer.c_str(), strerror(errno));
-	fprintf(f, "%s\n", abc_script.c_str());
-	fclose(f);
+// The gate library (stdcells.genlib) or the LUT library (lutdefs.txt) for
+// ABC when no -liberty or -genlib file is given. It is the same for all
+// domains, so it is generated once and written once to the abc work
+// directory, where the scripts of all domains read it. With -inmem every
+// job gets an in-memory copy.
+struct orlo_builtin_library_t
+{
+	bool enabled = false;
+	std::string genlib_text, lutdefs_text;
+	// The contents for the cache keys and the fingerprints
+	std::string hash;
 
-	if (dff_mode || !clk_str.empty())
+	void generate(const vector<int> &lut_costs)
 	{
-		if (clk_sig.size() == 0)
-			log("No%s clock domain found. Not extracting any FF cells.\n", clk_str.empty() ? "" : " matching");
-		else {
-			log("Found%s %s clock domain: %s", clk_str.empty() ? "" : " matching", clk_polarity ? "posedge" : "negedge", log_signal(clk_sig));
-			if (en_sig.size() != 0)
-				log(", enabled by %s%s", en_polarity ? "" : "!", log_signal(en_sig));
-			log("\n");
+		enabled = true;
+		if (!lut_costs.empty()) {
+			for (int i = 0; i < GetSize(lut_costs); i++)
+				lutdefs_text += stringf("%d %d.00 1.00\n", i+1, lut_costs.at(i));
+		} else {
+			auto &cell_cost = cmos_cost ? CellCosts::cmos_gate_cost() : CellCosts::default_gate_cost();
+
+			genlib_text += stringf("GATE ZERO    1 Y=CONST0;\n");
+			genlib_text += stringf("GATE ONE     1 Y=CONST1;\n");
+			genlib_text += stringf("GATE BUF    %d Y=A;                  PIN * NONINV  1 999 1 0 1 0\n", cell_cost.at(ID($_BUF_)));
+			genlib_text += stringf("GATE NOT    %d Y=!A;                 PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_NOT_)));
+			if (enabled_gates.count("AND"))
+				genlib_text += stringf("GATE AND    %d Y=A*B;                PIN * NONINV  1 999 1 0 1 0\n", cell_cost.at(ID($_AND_)));
+			if (enabled_gates.count("NAND"))
+				genlib_text += stringf("GATE NAND   %d Y=!(A*B);             PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_NAND_)));
+			if (enabled_gates.count("OR"))
+				genlib_text += stringf("GATE OR     %d Y=A+B;                PIN * NONINV  1 999 1 0 1 0\n", cell_cost.at(ID($_OR_)));
+			if (enabled_gates.count("NOR"))
+				genlib_text += stringf("GATE NOR    %d Y=!(A+B);             PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_NOR_)));
+			if (enabled_gates.count("XOR"))
+				genlib_text += stringf("GATE XOR    %d Y=(A*!B)+(!A*B);      PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_XOR_)));
+			if (enabled_gates.count("XNOR"))
+				genlib_text += stringf("GATE XNOR   %d Y=(A*B)+(!A*!B);      PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_XNOR_)));
+			if (enabled_gates.count("ANDNOT"))
+				genlib_text += stringf("GATE ANDNOT %d Y=A*!B;               PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_ANDNOT_)));
+			if (enabled_gates.count("ORNOT"))
+				genlib_text += stringf("GATE ORNOT  %d Y=A+!B;               PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_ORNOT_)));
+			if (enabled_gates.count("AOI3"))
+				genlib_text += stringf("GATE AOI3   %d Y=!((A*B)+C);         PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_AOI3_)));
+			if (enabled_gates.count("OAI3"))
+				genlib_text += stringf("GATE OAI3   %d Y=!((A+B)*C);         PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_OAI3_)));
+			if (enabled_gates.count("AOI4"))
+				genlib_text += stringf("GATE AOI4   %d Y=!((A*B)+(C*D));     PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_AOI4_)));
+			if (enabled_gates.count("OAI4"))
+				genlib_text += stringf("GATE OAI4   %d Y=!((A+B)*(C+D));     PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_OAI4_)));
+			if (enabled_gates.count("MUX"))
+				genlib_text += stringf("GATE MUX    %d Y=(A*B)+(S*B)+(!S*A); PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_MUX_)));
+			if (enabled_gates.count("NMUX"))
+				genlib_text += stringf("GATE NMUX   %d Y=!((A*B)+(S*B)+(!S*A)); PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_NMUX_)));
+			if (map_mux4)
+				genlib_text += stringf("GATE MUX4   %d Y=(!S*!T*A)+(S*!T*B)+(!S*T*C)+(S*T*D); PIN * UNKNOWN 1 999 1 0 1 0\n", 2*cell_cost.at(ID($_MUX_)));
+			if (map_mux8)
+				genlib_text += stringf("GATE MUX8   %d Y=(!S*!T*!U*A)+(S*!T*!U*B)+(!S*T*!U*C)+(S*T*!U*D)+(!S*!T*U*E)+(S*!T*U*F)+(!S*T*U*G)+(S*T*U*H); PIN * UNKNOWN 1 999 1 0 1 0\n", 4*cell_cost.at(ID($_MUX_)));
+			if (map_mux16)
+				genlib_text += stringf("GATE MUX16  %d Y=(!S*!T*!U*!V*A)+(S*!T*!U*!V*B)+(!S*T*!U*!V*C)+(S*T*!U*!V*D)+(!S*!T*U*!V*E)+(S*!T*U*!V*F)+(!S*T*U*!V*G)+(S*T*U*!V*H)+(!S*!T*!U*V*I)+(S*!T*!U*V*J)+(!S*T*!U*V*K)+(S*T*!U*V*L)+(!S*!T*U*V*M)+(S*!T*U*V*N)+(!S*T*U*V*O)+(S*T*U*V*P); PIN * UNKNOWN 1 999 1 0 1 0\n", 8*cell_cost.at(ID($_MUX_)));
 		}
+		SHA1 sha;
+		sha.update(genlib_text.empty() ? "lutdefs.txt\n" + lutdefs_text : "stdcells.genlib\n" + genlib_text);
+		hash = sha.final();
 	}
 
-	for (auto c : cells)
-		extract_cell(c, keepff);
-
-	for (auto wire : module->wires()) {
-		if (wire->port_id > 0 || wire->get_bool_attribute(ID::keep))
-			mark_port(wire);
+	std::string file_name() const
+	{
+		return genlib_text.empty() ? "lutdefs.txt" : "stdcells.genlib";
 	}
 
-	for (auto cell : module->cells())
-	for (auto &port_it : cell->connections())
-		mark_port(port_it.second);
+	const std::string &text() const
+	{
+		return genlib_text.empty() ? lutdefs_text : genlib_text;
+	}
 
-	if (clk_sig.size() != 0)
-		mark_port(clk_sig);
+	// The ABC command that reads the library from dir
+	std::string command(const std::string &dir) const
+	{
+		return stringf("%s %s/%s", genlib_text.empty() ? "read_lut" : "read_library", dir.c_str(), file_name().c_str());
+	}
 
-	if (en_sig.size() != 0)
-		mark_port(en_sig);
+	void write(const std::string &topdir_name) const
+	{
+		std::string filename = topdir_name + "/" + file_name();
+		std::ofstream f(filename, std::ios::binary);
+		f << text();
+		f.close();
+		if (f.fail())
+			log_error("Writing %s failed: %s\n", filename.c_str(), strerror(errno));
+	}
+};
 
-	handle_loops();
+// Put the delay target into the {D} of a script.
+std::string orlo_delay_script(std::string abc_script, const std::string &delay_target)
+{
+	for (size_t pos = abc_script.find("{D}"); pos != std::string::npos; pos = abc_script.find("{D}", pos))
+		abc_script = abc_script.substr(0, pos) + delay_target + abc_script.substr(pos+3);
+	return abc_script;
+}
 
-	buffer = stringf("%s/input.blif", tempdir_name.c_str());
-	f = fopen(buffer.c_str(), "wt");
-	if (f == nullptr)
-		log_error("Opening %s for writing failed: %s\n", buffer.c_str(), strerror(errno));
+// Add the write_blif of the output to a script, with an echo in front of
+// every command and every command on a line of its own.
+std::string orlo_finish_script(std::string abc_script, const std::string &tempdir_name, const std::string &output_name)
+{
+	abc_script += stringf("; write_blif %s/%s", tempdir_name.c_str(), output_name.c_str());
+	abc_script = add_echos_to_abc_cmd(abc_script);
 
-	fprintf(f, ".model netlist\n");
+	for (size_t i = 0; i+1 < abc_script.size(); i++)
+		if (abc_script[i] == ';' && abc_script[i+1] == ' ')
+			abc_script[i+1] = '\n';
+	return abc_script;
+}
+
+void orlo_module(RTLIL::Design *design, orlo_job_t &job, std::string script_file, const std::vector<std::string> &strategies,
+		std::vector<std::string> &liberty_files, std::vector<std::string> &genlib_files, std::string constr_file,
+		bool cleanup, vector<int> lut_costs, bool dff_mode, std::string clk_str, bool keepff, std::string delay_target,
+		std::string sop_inputs, std::string sop_products, std::string lutin_shared, bool fast_mode,
+        const std::vector<RTLIL::Cell*> &cells, bool show_tempdir, bool sop_mode, bool abc_dress,
+        std::string topdir_name, int clk_domain, bool refine)
+{
+	orlo_phase_timer_t extract_timer;
+	job.map_autoidx = autoidx++;
+	job.clk_domain = clk_domain;
+
+	if (clk_str != "$")
+	{
+		job.clk_polarity = true;
+		job.clk_sig = RTLIL::SigSpec();
+
+		job.en_polarity = true;
+		job.en_sig = RTLIL::SigSpec();
+	}
+
+	if (!clk_str.empty() && clk_str != "$")
+	{
+		if (clk_str.find(',') != std::string::npos) {
+			int pos = clk_str.find(',');
+			std::string en_str = clk_str.substr(pos+1);
+			clk_str = clk_str.substr(0, pos);
+			if (en_str[0] == '!') {
+				job.en_polarity = false;
+				en_str = en_str.substr(1);
+			}
+			if (job.module->wire(RTLIL::escape_id(en_str)) != nullptr)
+				job.en_sig = job.assign_map(job.module->wire(RTLIL::escape_id(en_str)));
+		}
+		if (clk_str[0] == '!') {
+			job.clk_polarity = false;
+			clk_str = clk_str.substr(1);
+		}
+		if (job.module->wire(RTLIL::escape_id(clk_str)) != nullptr)
+			job.clk_sig = job.assign_map(job.module->wire(RTLIL::escape_id(clk_str)));
+	}
+
+	if (dff_mode && job.clk_sig.empty())
+		log_cmd_error("Clock domain %s not found.\n", clk_str.c_str());
+	job.domain_key = orlo_domain_key(job);
+
+	//std::string tempdir_name = "/tmp/" + proc_program_prefix()+ "yosys-abc-XXXXXX";
+	std::string tempdir_name = orlo_module2name(job.module, topdir_name, clk_domain);
+	//if (!cleanup)
+	//	tempdir_name[0] = tempdir_name[4] = '_';
+    
+	//tempdir_name = make_temp_dir(tempdir_name);
+
+	log_header(design, "Extracting gate netlist of module `%s' to `%s/input.blif'..\n",
+			job.module->name.c_str(), replace_tempdir(tempdir_name, tempdir_name, show_tempdir).c_str());
+
+	std::string abc_prefix = stringf("read_blif %s/input.blif; ", tempdir_name.c_str());
+
+	if (!liberty_files.empty() || !genlib_files.empty()) {
+		for (auto &cmd : orlo_library_commands(liberty_files, genlib_files, constr_file))
+			abc_prefix += cmd + "; ";
+	} else {
+		// The shared copy of the library is in the abc work directory
+		log_assert(job.library != nullptr);
+		abc_prefix += job.library->command(job.inmem ? tempdir_name : topdir_name) + "; ";
+	}
+
+	// Every strategy gets its own script and output file, all of them read
+	// the same input.blif. The area and delay are printed last for scoring.
+	std::vector<orlo_abc_run_t*> runs;
+	if (strategies.empty())
+		runs.push_back(&job);
+	else {
+		job.strategies.resize(strategies.size());
+		for (int i = 0; i < GetSize(strategies); i++) {
+			orlo_abc_run_t &run = job.strategies[i];
+			run.strategy = strategies[i];
+			run.script_name = stringf("abc_%d.script", i);
+			run.output_name = stringf("output_%d.blif", i);
+			runs.push_back(&run);
+		}
+	}
+
+	for (auto run : runs)
+	{
+		std::string abc_script = abc_prefix;
+		if (run->strategy == "default" || run->strategy == "fast")
+			abc_script += orlo_script_body("", run->strategy == "fast", liberty_files, genlib_files, constr_file,
+					lut_costs, delay_target, sop_mode);
+		else if (!run->strategy.empty())
+			abc_script += run->strategy;
+		else
+			abc_script += orlo_script_body(script_file, fast_mode, liberty_files, genlib_files, constr_file,
+					lut_costs, delay_target, sop_mode);
+
+		for (size_t pos = abc_script.find("{I}"); pos != std::string::npos; pos = abc_script.find("{I}", pos))
+			abc_script = abc_script.substr(0, pos) + sop_inputs + abc_script.substr(pos+3);
+
+		for (size_t pos = abc_script.find("{P}"); pos != std::string::npos; pos = abc_script.find("{P}", pos))
+			abc_script = abc_script.substr(0, pos) + sop_products + abc_script.substr(pos+3);
+
+		for (size_t pos = abc_script.find("{S}"); pos != std::string::npos; pos = abc_script.find("{S}", pos))
+			abc_script = abc_script.substr(0, pos) + lutin_shared + abc_script.substr(pos+3);
+		if (abc_dress)
+			abc_script += "; dress";
+		if (!strategies.empty() || refine)
+			abc_script += liberty_files.empty() ? "; print_stats" : "; stime";
+		// -refine: the script again with a delay target of its own
+		if (refine && abc_script.find("{D}") != std::string::npos)
+			job.delay_script = abc_script;
+
+		run->abc_script = orlo_finish_script(orlo_delay_script(abc_script, delay_target), tempdir_name, run->output_name);
+		run->output_blif = tempdir_name + "/" + run->output_name;
+	}
+
+	if (dff_mode || !clk_str.empty())
+	{
+		if (job.clk_sig.size() == 0)
+			log("No%s clock domain found. Not extracting any FF cells.\n", clk_str.empty() ? "" : " matching");
+		else {
+			log("Found%s %s clock domain: %s", clk_str.empty() ? "" : " matching", job.clk_polarity ? "posedge" : "negedge", log_signal(job.clk_sig));
+			if (job.en_sig.size() != 0)
+				log(", enabled by %s%s", job.en_polarity ? "" : "!", log_signal(job.en_sig));
+			log("\n");
+		}
+	}
+
+	for (auto c : cells)
+		if (extract_cell(job, c, keepff))
+			job.extracted_cells.push_back(c);
+
+	// The extracted cells are only removed once all domains of the module
+	// have been extracted, so they must not mark any ports themselves.
+	pool<RTLIL::Cell*> extracted(job.extracted_cells.begin(), job.extracted_cells.end());
+
+	for (auto wire : job.module->wires()) {
+		if (wire->port_id > 0 || wire->get_bool_attribute(ID::keep))
+			mark_port(job, wire);
+	}
+
+	for (auto cell : job.module->cells()) {
+		if (extracted.count(cell))
+			continue;
+		for (auto &port_it : cell->connections())
+			mark_port(job, port_it.second);
+	}
+
+	if (job.clk_sig.size() != 0)
+		mark_port(job, job.clk_sig);
+
+	if (job.en_sig.size() != 0)
+		mark_port(job, job.en_sig);
+
+	job.phases[ORLO_PHASE_EXTRACT].add(extract_timer.stop());
+	orlo_phase_timer_t loops_timer;
+	handle_loops(job);
+	job.phases[ORLO_PHASE_LOOPS].add(loops_timer.stop());
+	extract_timer = orlo_phase_timer_t();
+
+	for (auto &si : job.signal_list) {
+		const gate_bit_t &sb = job.signal_bits[si.id];
+		if (si.is_port && si.type == G(NONE))
+			job.pi_map[job.count_input++] = log_signal(sb.bit);
+		if (si.is_port && si.type != G(NONE))
+			job.po_map[job.count_output++] = log_signal(sb.bit);
+		if (si.type == G(FF) && (sb.init == State::S0 || sb.init == State::S1))
+			job.recover_init = true;
+		if (si.type != G(NONE))
+			job.count_gates++;
+	}
+	job.tempdir_name = tempdir_name;
+	// The directory is made once the counts are known, an empty domain
+	// leaves no files behind.
+	if (!job.inmem && job.count_output > 0 && mkdir(tempdir_name.c_str(), 0777) != 0)
+		log_cmd_error("Could not create %s directory.\n", tempdir_name.c_str());
+	if (blif_comments)
+		for (auto &si : job.signal_list)
+			job.blif_comments += stringf("# ys__n%-5d %s\n", si.id, orlo_signal_name(job.signal_bits[si.id].bit).c_str());
+	if (!job.inmem && job.count_output > 0 && !orlo_write_signals(job, tempdir_name + "/signals.bin"))
+		log_warning("Could not write %s/signals.bin, orlo_reint will extract the domain again.\n", tempdir_name.c_str());
+	job.finish_extraction();
+
+	log("Extracted %d gates and %d wires to a netlist network with %d inputs and %d outputs.\n",
+			job.count_gates, GetSize(job.signal_list), job.count_input, job.count_output);
+	if (job.count_output == 0)
+		log("Don't call ABC as there is nothing to map.\n");
+	job.phases[ORLO_PHASE_EXTRACT].add(extract_timer.stop());
+
+    // I've kinda lost track of where I should put the cleanup and
+    
+    /*
+	if (cleanup)
+	{
+		log("Removing temp directory.\n");
+		remove_directory(tempdir_name);
+	}
+    */
+}
+
+// The shell command that runs an ABC script, with its stderr going the
+// way of the output given by redirect.
+std::string orlo_abc_command(const std::string &exe_file, const std::string &script_file, const std::string &redirect = "2>&1")
+{
+	return stringf("%s -s -f %s %s", exe_file.c_str(), script_file.c_str(), redirect.c_str());
+}
+
+// Run an ABC script, the executable or the linked ABC. The output lines go
+// to process_line, except for the linked ABC that prints them itself.
+int orlo_exec_abc(const std::string &exe_file, const std::string &script_file,
+		std::function<void(const std::string&)> process_line)
+{
+#ifndef YOSYS_LINK_ABC
+	return run_command(orlo_abc_command(exe_file, script_file), process_line);
+#else
+	// These needs to be mutable, supposedly due to getopt
+	char *abc_argv[5];
+	abc_argv[0] = strdup(exe_file.c_str());
+	abc_argv[1] = strdup("-s");
+	abc_argv[2] = strdup("-f");
+	abc_argv[3] = strdup(script_file.c_str());
+	abc_argv[4] = 0;
+	int ret = Abc_RealMain(4, abc_argv);
+	free(abc_argv[0]);
+	free(abc_argv[1]);
+	free(abc_argv[2]);
+	free(abc_argv[3]);
+	return ret;
+#endif
+}
+
+// Run ABC on an extracted job. This may run on a worker thread, so it must
+// not touch the design or the log.
+void orlo_run_abc(const orlo_job_t &job, orlo_abc_run_t &run, const std::string &exe_file, const std::string &script_file)
+{
+	run.abc_command = orlo_abc_command(exe_file, script_file);
+	abc_output_filter filt(&job, &run.abc_output);
+	run.abc_ret = orlo_exec_abc(exe_file, script_file, std::bind(&abc_output_filter::next_line, filt, std::placeholders::_1));
+}
+
+// The files a job hands to ABC. They live in the temp dir of the job, or with
+// -inmem in anonymous memory files (memfd) that ABC opens as /proc/<pid>/fd/<n>.
+// That path works for the linked ABC as well as for any ABC process, also one
+// of -abc_pool that was started before the file was created, so the
+// descriptors don't need to be inherited.
+struct orlo_job_files_t
+{
+	orlo_job_t &job;
+	dict<std::string, int> fds;
+
+	orlo_job_files_t(orlo_job_t &job) : job(job) { }
+
+	~orlo_job_files_t()
+	{
+		for (auto &it : fds)
+			close(it.second);
+	}
+
+	std::string path(const std::string &name)
+	{
+		if (!job.inmem)
+			return job.tempdir_name + "/" + name;
+		if (!fds.count(name)) {
+#ifdef __linux__
+			int fd = memfd_create(name.c_str(), MFD_CLOEXEC);
+#else
+			int fd = -1;
+			errno = ENOSYS;
+#endif
+			if (fd < 0) {
+				job.error = stringf("Creating in-memory file %s failed: %s\n", name.c_str(), strerror(errno));
+				return "/dev/null";
+			}
+			fds[name] = fd;
+		}
+		return stringf("/proc/%d/fd/%d", int(getpid()), fds.at(name));
+	}
+
+	bool write(const std::string &name, const std::string &text)
+	{
+		std::string filename = path(name);
+		if (!job.error.empty())
+			return false;
+		std::ofstream f(filename, std::ios::binary | std::ios::trunc);
+		f << text;
+		f.close();
+		if (f.fail()) {
+			job.error = stringf("Writing %s failed: %s\n", filename.c_str(), strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	std::string read(const std::string &name)
+	{
+		std::ifstream f(path(name), std::ios::binary);
+		std::stringstream text;
+		text << f.rdbuf();
+		return text.str();
+	}
+
+	// Point the file names in the ABC script to the in-memory files.
+	std::string script(std::string abc_script, const std::string &output_name)
+	{
+		if (!job.inmem)
+			return abc_script;
+		for (auto name : {"input.blif", "stdcells.genlib", "lutdefs.txt", output_name.c_str()}) {
+			std::string filename = job.tempdir_name + "/" + name;
+			for (size_t pos = abc_script.find(filename); pos != std::string::npos; pos = abc_script.find(filename, pos))
+				abc_script.replace(pos, GetSize(filename), path(name));
+		}
+		return abc_script;
+	}
+};
+
+// -abc_pool: ABC processes that are kept running for all jobs of the pass,
+// one for every worker thread. The libraries given by the user are read once
+// when a process starts. Then every run sources a variant of its script
+// without those reads, followed by an echo of a marker that tells when ABC
+// is done. ABC talks to a pseudo terminal, so that its output is line buffered
+// and the marker is not stuck in a buffer.
+struct orlo_abc_pool_t
+{
+	bool enabled = false;
+	std::vector<std::string> library_commands;
+
+	// The name of the script variant for the pool.
+	static std::string script_name(const orlo_abc_run_t &run)
+	{
+		return "pool_" + run.script_name;
+	}
+
+	// Drop the library reads, and the echos of them, from an ABC script.
+	std::string script(const std::string &abc_script) const
+	{
+		std::string script = abc_script;
+		for (auto &cmd : library_commands)
+			for (auto token : {"echo + " + cmd + "; ", cmd + "; "})
+				for (size_t pos = script.find(token); pos != std::string::npos; pos = script.find(token, pos))
+					script.erase(pos, GetSize(token));
+		return script;
+	}
+};
+
+#define ORLO_POOL_MARKER "ORLO_ABC_POOL_DONE"
+
+struct orlo_abc_process_t
+{
+	int fd = -1;
+	int pid = -1;
+	std::string pending;
+
+	~orlo_abc_process_t()
+	{
+		stop();
+	}
+
+	bool running() const { return pid > 0; }
+
+	bool start(const std::string &exe_file, const orlo_abc_pool_t &pool, std::string &error)
+	{
+#ifndef _WIN32
+		// Serialize the forks, the descriptors of one process must not leak
+		// into one started by another worker at the same time.
+		static std::mutex start_mutex;
+		std::lock_guard<std::mutex> lock(start_mutex);
+
+		int master = posix_openpt(O_RDWR | O_NOCTTY);
+		if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+			error = stringf("Creating a pseudo terminal for ABC failed: %s\n", strerror(errno));
+			if (master >= 0)
+				close(master);
+			return false;
+		}
+		fcntl(master, F_SETFD, FD_CLOEXEC);
+		int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+		if (slave < 0) {
+			error = stringf("Opening the pseudo terminal for ABC failed: %s\n", strerror(errno));
+			close(master);
+			return false;
+		}
+		// No echo of the commands and no \r\n in the output
+		struct termios tio;
+		tcgetattr(slave, &tio);
+		cfmakeraw(&tio);
+		tcsetattr(slave, TCSANOW, &tio);
+
+		// The child reports a failed exec through this pipe, it is closed
+		// without data when the exec succeeds.
+		int status[2];
+		if (pipe(status) != 0) {
+			error = stringf("Creating a pipe for ABC failed: %s\n", strerror(errno));
+			close(slave);
+			close(master);
+			return false;
+		}
+		fcntl(status[0], F_SETFD, FD_CLOEXEC);
+		fcntl(status[1], F_SETFD, FD_CLOEXEC);
+
+		pid = fork();
+		if (pid == 0) {
+			setsid();
+			dup2(slave, 0);
+			dup2(slave, 1);
+			dup2(slave, 2);
+			if (slave > 2)
+				close(slave);
+			close(status[0]);
+			// Like the shell orlo_run_abc() goes through, look up the
+			// executable in PATH
+			execlp(exe_file.c_str(), exe_file.c_str(), "-s", (char*)nullptr);
+			int err = errno;
+			if (::write(status[1], &err, sizeof(err)) < 0) { }
+			_exit(127);
+		}
+		close(slave);
+		close(status[1]);
+		if (pid < 0) {
+			error = stringf("Starting ABC failed: %s\n", strerror(errno));
+			close(status[0]);
+			close(master);
+			return false;
+		}
+		int err = 0;
+		ssize_t n;
+		while ((n = ::read(status[0], &err, sizeof(err))) < 0 && errno == EINTR) { }
+		close(status[0]);
+		if (n > 0) {
+			error = stringf("Could not execute ABC `%s': %s\n", exe_file.c_str(), strerror(err));
+			close(master);
+			waitpid(pid, nullptr, 0);
+			pid = -1;
+			return false;
+		}
+		fd = master;
+
+		std::string prelude;
+		for (auto &cmd : pool.library_commands)
+			prelude += cmd + "\n";
+		std::vector<std::string> lines;
+		if (!execute(prelude, lines)) {
+			error = stringf("ABC process %s exited while reading the libraries:\n", exe_file.c_str());
+			for (auto &line : lines)
+				error += line + "\n";
+			stop();
+			return false;
+		}
+		return true;
+#else
+		error = "-abc_pool is not supported on this platform.\n";
+		return false;
+#endif
+	}
+
+	// Send the commands and collect the output lines until the marker. This
+	// fails if ABC exits before it gets to the marker.
+	bool execute(const std::string &commands, std::vector<std::string> &lines)
+	{
+#ifndef _WIN32
+		std::string text = commands + "echo " ORLO_POOL_MARKER "\n";
+		for (size_t pos = 0; pos < text.size();) {
+			ssize_t n = ::write(fd, text.data() + pos, text.size() - pos);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			pos += n;
+		}
+
+		char buf[4096];
+		while (1) {
+			size_t eol;
+			while ((eol = pending.find('\n')) != std::string::npos) {
+				std::string line = pending.substr(0, eol);
+				pending.erase(0, eol + 1);
+				// Strip the prompts ("abc 01> ") ABC prints before reading a line
+				while (line.compare(0, 4, "abc ") == 0) {
+					size_t end = line.find_first_not_of("0123456789", 4);
+					if (end == std::string::npos || line.compare(end, 2, "> ") != 0)
+						break;
+					line.erase(0, end + 2);
+				}
+				if (line.find_last_not_of(' ') != std::string::npos)
+					line.erase(line.find_last_not_of(' ') + 1);
+				if (line == ORLO_POOL_MARKER)
+					return true;
+				lines.push_back(line);
+			}
+			ssize_t n = ::read(fd, buf, sizeof(buf));
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return false;
+			pending.append(buf, n);
+		}
+#else
+		return false;
+#endif
+	}
+
+	void stop()
+	{
+#ifndef _WIN32
+		if (fd >= 0) {
+			if (::write(fd, "quit\n", 5) < 0) { }
+			close(fd);
+			fd = -1;
+		}
+		if (pid > 0)
+			waitpid(pid, nullptr, 0);
+		pid = -1;
+		pending.clear();
+#endif
+	}
+};
+
+// Run ABC for a job in a process of the pool, starting it if needed.
+void orlo_run_abc_pool(const orlo_job_t &job, orlo_abc_run_t &run, const std::string &exe_file, const orlo_abc_pool_t &pool,
+		orlo_abc_process_t &process, const std::string &script_file)
+{
+	run.abc_command = stringf("source %s", script_file.c_str());
+	std::string error;
+	if (!process.running() && !process.start(exe_file, pool, error)) {
+		run.abc_output.push_back(error);
+		run.start_error = error;
+		run.abc_ret = -1;
+		return;
+	}
+
+	std::vector<std::string> lines;
+	bool ok = process.execute(run.abc_command + "\n", lines);
+	abc_output_filter filt(&job, &run.abc_output);
+	for (auto &line : lines)
+		filt.next_line(line + "\n");
+	if (!ok) {
+		// The next job gets a fresh process
+		process.stop();
+		run.abc_ret = -1;
+	}
+}
+
+bool orlo_copy_file(const std::string &from, const std::string &to)
+{
+	std::ifstream src(from, std::ios::binary);
+	std::ofstream dst(to, std::ios::binary);
+	if (src.fail() || dst.fail())
+		return false;
+	dst << src.rdbuf();
+	return !dst.fail();
+}
+
+// -compress: replace a file by a gzipped copy with a .gz suffix
+bool orlo_gzip_file(const std::string &filename)
+{
+#ifdef YOSYS_ENABLE_ZLIB
+	std::ifstream src(filename, std::ios::binary);
+	std::string tmp = filename + ".gz.tmp";
+	gzFile dst = gzopen(tmp.c_str(), "wb3");
+	if (src.fail() || dst == nullptr) {
+		if (dst != nullptr)
+			gzclose(dst);
+		return false;
+	}
+	char buf[1 << 16];
+	bool ok = true;
+	while (ok && src) {
+		src.read(buf, sizeof(buf));
+		if (src.gcount() > 0)
+			ok = gzwrite(dst, buf, src.gcount()) == src.gcount();
+	}
+	ok = gzclose(dst) == Z_OK && ok && src.eof();
+	if (ok && rename(tmp.c_str(), (filename + ".gz").c_str()) == 0)
+		return remove(filename.c_str()) == 0;
+	remove(tmp.c_str());
+	return false;
+#else
+	return false;
+#endif
+}
+
+// A hash of the ABC executable and of the contents of the libraries and of
+// the -script file, which abc.script only sources.
+std::string orlo_library_hash(const std::string &exe_file, const std::vector<std::string> &liberty_files,
+		const std::vector<std::string> &genlib_files, const std::string &constr_file, const std::string &script_file)
+{
+	SHA1 sha;
+	sha.update(exe_file + "\n");
+	for (auto &file : liberty_files)
+		sha.update("liberty " + SHA1::from_file(file) + "\n");
+	for (auto &file : genlib_files)
+		sha.update("genlib " + SHA1::from_file(file) + "\n");
+	if (!constr_file.empty())
+		sha.update("constr " + SHA1::from_file(constr_file) + "\n");
+	if (!script_file.empty() && script_file[0] != '+')
+		sha.update("script " + SHA1::from_file(script_file) + "\n");
+	return sha.final();
+}
+
+// Content addressed store of ABC results (see -cache_dir). The key of a job
+// hashes its input.blif, its abc.script (without the temp dir name) and the
+// contents of all library files, so a hit can only return the output.blif
+// ABC would have produced for the same job.
+struct orlo_cache_t
+{
+	std::string dir;
+	std::string lib_hash;
+	bool copy_to_tempdir = false;
+
+	bool enabled() const { return !dir.empty(); }
+
+	std::string entry(const std::string &key) const
+	{
+		return stringf("%s/%s.blif", dir.c_str(), key.c_str());
+	}
+
+	void set_libraries(const std::string &exe_file, const std::vector<std::string> &liberty_files,
+			const std::vector<std::string> &genlib_files, const std::string &constr_file, const std::string &script_file)
+	{
+		lib_hash = orlo_library_hash(exe_file, liberty_files, genlib_files, constr_file, script_file);
+	}
+
+	static std::string hash(const std::string &text)
+	{
+		SHA1 sha;
+		sha.update(text);
+		return sha.final();
+	}
+
+	// The lookup and the store run on the worker threads.
+	bool lookup(const orlo_job_t &job, orlo_abc_run_t &run, const std::string &input_hash) const
+	{
+		if (!enabled())
+			return false;
+
+		SHA1 sha;
+		sha.update(lib_hash + "\n");
+		std::string topdir_name = job.tempdir_name.substr(0, job.tempdir_name.rfind('/'));
+		sha.update(replace_tempdir(replace_tempdir(run.abc_script, job.tempdir_name, false), topdir_name, false) + "\n");
+		sha.update(stringf("input.blif %s\n", input_hash.c_str()));
+		if (job.library != nullptr)
+			sha.update(stringf("%s %s\n", job.library->file_name().c_str(), job.library->hash.c_str()));
+		run.cache_key = sha.final();
+
+		std::string cached = entry(run.cache_key);
+		if (!exists(cached))
+			return false;
+		bool copy = copy_to_tempdir && !job.inmem;
+		if (copy && !orlo_copy_file(cached, run.output_blif))
+			return false;
+		if (!copy)
+			run.output_blif = cached;
+		run.cache_hit = true;
+		// -refine: the area and delay of the cached run
+		std::ifstream score(cached + ".score");
+		double area, delay;
+		if (score >> area >> delay) {
+			run.scored = true;
+			run.area = area;
+			run.delay = delay;
+		}
+		return true;
+	}
+
+	void store(const orlo_job_t &job, const orlo_abc_run_t &run) const
+	{
+		if (!enabled() || run.cache_key.empty())
+			return;
+
+		// Several runs may share the cache, so only complete entries are
+		// renamed into place.
+		std::string cached = entry(run.cache_key);
+		std::string tmp = stringf("%s.%d.%d.tmp", cached.c_str(), int(getpid()), job.map_autoidx);
+		bool written;
+		if (job.inmem) {
+			std::ofstream f(tmp, std::ios::binary);
+			f << run.output_text;
+			f.close();
+			written = !f.fail();
+		} else
+			written = orlo_copy_file(run.output_blif, tmp);
+		if (written && run.scored) {
+			std::ofstream score(tmp + ".score");
+			score << stringf("%.17g %.17g\n", run.area, run.delay);
+			score.close();
+			if (score.fail() || rename((tmp + ".score").c_str(), (cached + ".score").c_str()) != 0)
+				remove((tmp + ".score").c_str());
+		}
+		if (written)
+			rename(tmp.c_str(), cached.c_str());
+		else
+			remove(tmp.c_str());
+	}
+};
+
+// -incremental: reuse the results of the previous run for the jobs whose
+// logic did not change. The fingerprint of a job covers what input.blif
+// would contain, hashed straight from the extracted gates: their types and
+// connections by signal id, the port bits, constants and FF init values.
+// With the same fingerprint ABC sees the same netlist under the same
+// names, so its output.blif can be reintegrated into the new extraction
+// of the domain, even if the cells and wires around it were renamed.
+struct orlo_incremental_t
+{
+	bool enabled = false;
+	std::string lib_hash;
+	std::string previous_dir;
+	// fingerprint -> output.blif of the previous run
+	dict<std::string, std::string> previous;
+
+	// Read the fingerprint files in the domain directories of the
+	// previous abc work directory.
+	void load(const std::string &dir)
+	{
+		previous_dir = dir;
+#ifndef _WIN32
+		DIR *d = opendir(dir.c_str());
+		if (d == nullptr)
+			return;
+		for (struct dirent *ent = readdir(d); ent != nullptr; ent = readdir(d)) {
+			std::string name = ent->d_name;
+			if (name == "." || name == "..")
+				continue;
+			std::ifstream f(dir + "/" + name + "/fingerprint");
+			std::string fingerprint, output_blif = dir + "/" + name + "/output.blif";
+			if (!exists(output_blif))
+				output_blif += ".gz";
+			if (std::getline(f, fingerprint) && exists(output_blif))
+				previous[fingerprint] = output_blif;
+		}
+		closedir(d);
+#endif
+	}
+
+	void compute(orlo_job_t &job, bool by_delay) const
+	{
+		std::string topdir_name = job.tempdir_name.substr(0, job.tempdir_name.rfind('/'));
+		SHA1 sha;
+		sha.update(lib_hash + "\n");
+		std::vector<const orlo_abc_run_t*> runs;
+		if (job.strategies.empty())
+			runs.push_back(&job);
+		for (auto &run : job.strategies)
+			runs.push_back(&run);
+		for (auto run : runs)
+			sha.update(replace_tempdir(replace_tempdir(run->abc_script, job.tempdir_name, false), topdir_name, false) + "\n");
+		if (!job.strategies.empty())
+			sha.update(by_delay ? "metric delay\n" : "metric area\n");
+		if (job.library != nullptr)
+			sha.update(job.library->hash + "\n");
+
+		std::string gates;
+		for (auto &si : job.signal_list) {
+			const gate_bit_t &bit = job.signal_bits[si.id];
+			gates += stringf("%d %d %d %d %d %d", int(si.type), si.in1, si.in2, si.in3, si.in4, int(si.is_port));
+			if (bit.bit.wire == nullptr)
+				gates += bit.bit == RTLIL::State::S1 ? " 1" : " 0";
+			if (si.type == G(FF))
+				gates += stringf(" i%d", int(bit.init));
+			gates += "\n";
+			if (GetSize(gates) > 65536) {
+				sha.update(gates);
+				gates.clear();
+			}
+		}
+		sha.update(gates);
+		job.fingerprint = sha.final();
+	}
+
+	// Take the output.blif of the previous run if the job did not change.
+	// This runs on the main thread, before any ABC job.
+	bool lookup(orlo_job_t &job) const
+	{
+		if (!enabled || job.count_output == 0 || !previous.count(job.fingerprint))
+			return false;
+		const std::string &previous_blif = previous.at(job.fingerprint);
+		std::string output_blif = job.tempdir_name + "/output.blif" + (is_gz(previous_blif) ? ".gz" : "");
+		if (!orlo_copy_file(previous_blif, output_blif))
+			return false;
+		job.output_blif = output_blif;
+		job.strategies.clear();
+		job.reused = true;
+		return true;
+	}
+
+	// Leave the fingerprint next to the output.blif of the job for the next
+	// run. A result that came from the cache is copied here first.
+	void store(const orlo_job_t &job) const
+	{
+		if (!enabled || job.count_output == 0 || job.abc_ret != 0 || job.simcheck_result == ORLO_SIMCHECK_MISMATCH)
+			return;
+		std::string output_blif = job.tempdir_name + "/output.blif" + (is_gz(job.output_blif) ? ".gz" : "");
+		if (job.output_blif != output_blif && !orlo_copy_file(job.output_blif, output_blif))
+			return;
+		std::ofstream f(job.tempdir_name + "/fingerprint");
+		f << job.fingerprint << "\n";
+	}
+};
+
+// The index of the abc work directory, written by orlo once all domains
+// are mapped. After a header line with the version and a line naming the
+// columns, there is a line for every non-empty domain with tab-separated
+// fields: the domain key, the sub-directory, the numbers of gates, inputs
+// and outputs, and the SHA1 of its input.blif ("-" when ABC was not run).
+// orlo_reint looks the domains up by their key, a domain that is not in
+// the manifest was empty and has nothing to reintegrate. Other tools can
+// use it to find the ABC jobs of a run and to spread them over machines.
+struct orlo_manifest_t
+{
+	struct entry_t
+	{
+		std::string subdir;
+		int gates = 0, inputs = 0, outputs = 0;
+		std::string input_hash;
+	};
+
+	bool present = false;
+	dict<std::string, entry_t> domains;
+
+	static void write(const std::string &topdir_name, const std::deque<orlo_job_t> &jobs)
+	{
+		std::string tmp = topdir_name + "/manifest.tmp";
+		std::ofstream f(tmp);
+		f << ORLO_MANIFEST_HEADER << "\n";
+		f << "# key\tdirectory\tgates\tinputs\toutputs\tinput_sha1\n";
+		for (auto &job : jobs)
+			if (job.count_output > 0)
+				f << job.domain_key << "\t" << job.tempdir_name.substr(topdir_name.size() + 1) << "\t" << job.count_gates
+						<< "\t" << job.count_input << "\t" << job.count_output << "\t"
+						<< (job.input_hash.empty() ? "-" : job.input_hash) << "\n";
+		f.close();
+		if (!f || rename(tmp.c_str(), (topdir_name + "/manifest").c_str()) != 0)
+			log_warning("Could not write %s/manifest.\n", topdir_name.c_str());
+	}
+
+	void load(const std::string &topdir_name)
+	{
+		std::ifstream f(topdir_name + "/manifest");
+		std::string line;
+		if (!std::getline(f, line) || line != ORLO_MANIFEST_HEADER)
+			return;
+		present = true;
+		while (std::getline(f, line)) {
+			if (line.empty() || line[0] == '#')
+				continue;
+			std::vector<std::string> fields;
+			for (size_t pos = 0, tab; ; pos = tab + 1) {
+				tab = line.find('\t', pos);
+				fields.push_back(line.substr(pos, tab == std::string::npos ? std::string::npos : tab - pos));
+				if (tab == std::string::npos)
+					break;
+			}
+			if (GetSize(fields) != 6)
+				log_error("Malformed line in %s/manifest: %s\n", topdir_name.c_str(), line.c_str());
+			entry_t &entry = domains[fields[0]];
+			entry.subdir = fields[1];
+			entry.gates = atoi(fields[2].c_str());
+			entry.inputs = atoi(fields[3].c_str());
+			entry.outputs = atoi(fields[4].c_str());
+			entry.input_hash = fields[5];
+		}
+	}
+};
+
+// -emit_only: take the wires and connections of the broken loops out of the
+// module again, so that the design is left as it was for orlo_reint.
+void orlo_undo_loops(orlo_job_t &job)
+{
+	if (job.loop_breaks.empty())
+		return;
+	pool<RTLIL::Wire*> wires;
+	for (auto &it : job.loop_breaks)
+		wires.insert(job.signal_bits[it.first].bit.wire);
+	std::vector<RTLIL::SigSig> connections;
+	for (auto &conn : job.module->connections())
+		if (!conn.first.is_wire() || !wires.count(conn.first.as_wire()))
+			connections.push_back(conn);
+	job.module->new_connections(connections);
+	job.module->remove(wires);
+}
+
+// -simcheck: the function of a gate on 64 input vectors at once, the same
+// as its cover in orlo_blif_covers.
+inline uint64_t orlo_simulate_gate(gate_type_t type, uint64_t a, uint64_t b, uint64_t c, uint64_t d)
+{
+	switch (type)
+	{
+	case G(BUF): return a;
+	case G(NOT): return ~a;
+	case G(AND): return a & b;
+	case G(NAND): return ~(a & b);
+	case G(OR): return a | b;
+	case G(NOR): return ~(a | b);
+	case G(XOR): return a ^ b;
+	case G(XNOR): return ~(a ^ b);
+	case G(ANDNOT): return a & ~b;
+	case G(ORNOT): return a | ~b;
+	case G(MUX): return (a & ~c) | (b & c);
+	case G(NMUX): return ~((a & ~c) | (b & c));
+	case G(AOI3): return ~((a & b) | c);
+	case G(OAI3): return ~((a | b) & c);
+	case G(AOI4): return ~((a & b) | (c & d));
+	case G(OAI4): return ~((a | b) & (c | d));
+	default: log_abort();
+	}
+}
+
+// Order the nodes 0 to n-1 so that every node comes after the ones it
+// reads, reads(id, nodes) gives the nodes read by id. Returns false if
+// the nodes have a loop.
+template<typename F>
+bool orlo_topological_order(int n, F reads, std::vector<int> &order)
+{
+	// 0: not seen, 1: on the path from the root, 2: ordered
+	std::vector<char> mark(n);
+	std::vector<int> stack, inputs;
+	order.clear();
+	order.reserve(n);
+	for (int root = 0; root < n; root++) {
+		if (mark[root] != 0)
+			continue;
+		stack.push_back(root);
+		while (!stack.empty()) {
+			int id = stack.back();
+			if (mark[id] == 2) {
+				stack.pop_back();
+			} else if (mark[id] == 1) {
+				mark[id] = 2;
+				order.push_back(id);
+				stack.pop_back();
+			} else {
+				mark[id] = 1;
+				inputs.clear();
+				reads(id, inputs);
+				for (int in : inputs) {
+					if (mark[in] == 1)
+						return false;
+					if (mark[in] == 0)
+						stack.push_back(in);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// -simcheck: simulate the extracted logic of a job and ABC's output.blif
+// on the same random vectors, 64 vectors per word, ORLO_SIMCHECK_WORDS
+// words at a time, and compare the outputs and the inputs of the
+// flip-flops. The flip-flops are cut like the loops, their outputs get
+// random values just like the inputs of the domain, so a domain whose
+// flip-flops ABC changed (with a retiming script, for instance) is not
+// checked. Neither is the output of -liberty and -genlib, whose cells
+// have no known function here. Like the blif reader this only reads the
+// job and the tokens of output.blif.
+#define ORLO_SIMCHECK_WORDS 4
+
+struct orlo_simcheck_t
+{
+	typedef orlo_blif_reader_t::token_t token_t;
 
-	int count_input = 0;
-	fprintf(f, ".inputs");
-	for (auto &si : signal_list) {
-		if (!si.is_port || si.type != G(NONE))
+	// A gate of output.blif: a .names cover (its input planes in rows), a
+	// gate of the built-in library, MUX4/8/16 with the data inputs first
+	// and then the selects, or a constant
+	struct node_t
+	{
+		enum kind_t { COVER, GATE, MUXN, CONST } kind;
+		gate_type_t type = G(NONE);
+		int selects = 0;
+		bool onset = true;
+		int output = -1;
+		std::vector<int> inputs;
+		std::vector<const char*> rows;
+	};
+
+	struct net_t
+	{
+		int driver = -1;
+		bool input = false;
+		// The gate of the job for ys__n<id>, -1 for the nets ABC made
+		int ref_id = -1;
+	};
+
+	const orlo_job_t &job;
+	bool builtin_lib;
+	std::vector<node_t> nodes;
+	std::vector<net_t> nets;
+	std::unordered_map<token_t, int, orlo_blif_reader_t::token_hash_t> net_ids;
+	std::vector<std::pair<int, int>> latches;
+	std::vector<int> outputs;
+	std::string message;
+	uint64_t rng_state = 1;
+
+	orlo_simcheck_t(const orlo_job_t &job, bool builtin_lib) : job(job), builtin_lib(builtin_lib) { }
+
+	// splitmix64
+	uint64_t random()
+	{
+		uint64_t z = (rng_state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	int net(const token_t &tok)
+	{
+		auto it = net_ids.find(tok);
+		if (it != net_ids.end())
+			return it->second;
+		net_t n;
+		if (tok.len > 5 && strncmp(tok.p, "ys__n", 5) == 0) {
+			n.ref_id = 0;
+			for (int i = 5; i < tok.len && n.ref_id >= 0; i++)
+				n.ref_id = std::isdigit(tok.p[i]) && n.ref_id < GetSize(job.signal_list) ? 10*n.ref_id + (tok.p[i] - '0') : -1;
+			if (n.ref_id >= GetSize(job.signal_list))
+				n.ref_id = -1;
+		}
+		nets.push_back(n);
+		return net_ids[tok] = GetSize(nets) - 1;
+	}
+
+	std::string ref_name(int id) const
+	{
+		return stringf("%s (ys__n%d)", orlo_signal_name(job.signal_bits[id].bit).c_str(), id);
+	}
+
+	// Set up node as the gate of a .gate/.subckt line, false if it has no
+	// function known here
+	bool gate(const std::vector<token_t> &toks, node_t &node)
+	{
+		static const std::map<std::string, gate_type_t> builtin_gates = {
+			{ "BUF", G(BUF) }, { "NOT", G(NOT) }, { "AND", G(AND) }, { "NAND", G(NAND) },
+			{ "OR", G(OR) }, { "NOR", G(NOR) }, { "XOR", G(XOR) }, { "XNOR", G(XNOR) },
+			{ "ANDNOT", G(ANDNOT) }, { "ORNOT", G(ORNOT) }, { "MUX", G(MUX) }, { "NMUX", G(NMUX) },
+			{ "AOI3", G(AOI3) }, { "OAI3", G(OAI3) }, { "AOI4", G(AOI4) }, { "OAI4", G(OAI4) }
+		};
+
+		std::string type = toks[1].str();
+		int inputs = 0;
+		if (builtin_lib && (type == "ZERO" || type == "ONE")) {
+			node.kind = node_t::CONST;
+			node.onset = type == "ONE";
+		} else if (type == "_const0_" || type == "_const1_") {
+			node.kind = node_t::CONST;
+			node.onset = type == "_const1_";
+		} else if (builtin_lib && builtin_gates.count(type)) {
+			node.kind = node_t::GATE;
+			node.type = builtin_gates.at(type);
+			inputs = orlo_blif_covers[int(node.type)].inputs;
+		} else if (builtin_lib && (type == "MUX4" || type == "MUX8" || type == "MUX16")) {
+			node.kind = node_t::MUXN;
+			node.selects = type == "MUX4" ? 2 : type == "MUX8" ? 3 : 4;
+			inputs = (1 << node.selects) + node.selects;
+		} else {
+			message = stringf("the function of cell type %s is not known", type.c_str());
+			return false;
+		}
+
+		node.inputs.assign(inputs, -1);
+		for (size_t i = 2; i < toks.size(); i++) {
+			const char *eq = static_cast<const char*>(memchr(toks[i].p, '=', toks[i].len));
+			if (eq == nullptr || eq - toks[i].p != 1 || eq + 1 == toks[i].p + toks[i].len) {
+				message = stringf("a %s cell can not be simulated", type.c_str());
+				return false;
+			}
+			char pin = toks[i].p[0];
+			int conn = net(token_t{ eq + 1, int(toks[i].len - 2) });
+			int index = -1;
+			if (pin == 'Y' || node.kind == node_t::CONST)
+				index = -2;
+			else if (node.kind == node_t::MUXN && pin >= 'S' && pin < 'S' + node.selects)
+				index = (1 << node.selects) + (pin - 'S');
+			else if (node.kind == node_t::GATE && pin == 'S' && (node.type == G(MUX) || node.type == G(NMUX)))
+				index = 2;
+			else if (pin >= 'A' && pin - 'A' < inputs)
+				index = pin - 'A';
+			if (index == -2 && node.output < 0)
+				node.output = conn;
+			else if (index >= 0)
+				node.inputs[index] = conn;
+			else {
+				message = stringf("cell type %s has no pin %c", type.c_str(), pin);
+				return false;
+			}
+		}
+		for (int in : node.inputs)
+			if (in < 0) {
+				message = stringf("a %s cell has an unconnected input", type.c_str());
+				return false;
+			}
+		return node.output >= 0;
+	}
+
+	// Read output.blif into nodes. Returns false if it can not be compared.
+	bool read(const orlo_blif_output_t &output)
+	{
+		std::vector<token_t> toks;
+		node_t *names = nullptr;
+		for (auto &line : output.lines) {
+			toks.assign(output.toks.begin() + line.first, output.toks.begin() + line.first + line.count);
+			if (toks[0].p[0] != '.') {
+				if (names == nullptr)
+					return false;
+				if (names->kind == node_t::CONST) {
+					for (auto &tok : toks)
+						if (memchr(tok.p, '1', tok.len) != nullptr)
+							names->onset = true;
+					continue;
+				}
+				if (toks.size() != 2 || toks[0].len != GetSize(names->inputs) || !(toks[1] == "0" || toks[1] == "1"))
+					return false;
+				bool onset = toks[1] == "1";
+				if (!names->rows.empty() && names->onset != onset) {
+					message = "a cover mixes on-set and off-set rows";
+					return false;
+				}
+				names->onset = onset;
+				names->rows.push_back(toks[0].p);
+				continue;
+			}
+			names = nullptr;
+
+			if (toks[0] == ".inputs") {
+				for (size_t i = 1; i < toks.size(); i++)
+					nets[net(toks[i])].input = true;
+			} else if (toks[0] == ".outputs") {
+				for (size_t i = 1; i < toks.size(); i++)
+					outputs.push_back(net(toks[i]));
+			} else if (toks[0] == ".names") {
+				if (toks.size() < 2)
+					return false;
+				nodes.emplace_back();
+				names = &nodes.back();
+				names->kind = toks.size() == 2 ? node_t::CONST : node_t::COVER;
+				names->onset = false;
+				for (size_t i = 1; i + 1 < toks.size(); i++)
+					names->inputs.push_back(net(toks[i]));
+				names->output = net(toks.back());
+			} else if (toks[0] == ".gate" || toks[0] == ".subckt") {
+				nodes.emplace_back();
+				if (toks.size() < 2 || !gate(toks, nodes.back()))
+					return false;
+			} else if (toks[0] == ".latch") {
+				if (toks.size() < 3)
+					return false;
+				latches.push_back(std::make_pair(net(toks[1]), net(toks[2])));
+				nets[latches.back().second].input = true;
+			} else if (toks[0] == ".end") {
+				break;
+			}
+		}
+		// A cover without rows is constant 0
+		for (auto &node : nodes)
+			if (node.kind == node_t::COVER && node.rows.empty()) {
+				node.kind = node_t::CONST;
+				node.onset = false;
+			}
+		return true;
+	}
+
+	orlo_simcheck_result_t check(const orlo_blif_output_t &output, int vectors)
+	{
+		const int W = ORLO_SIMCHECK_WORDS;
+		int n = GetSize(job.signal_list);
+
+		if (!read(output)) {
+			if (message.empty())
+				message = "output.blif can not be simulated";
+			return ORLO_SIMCHECK_UNCHECKED;
+		}
+
+		// The flip-flops of the job and those of the output have to be
+		// the same, then their outputs are inputs of both netlists.
+		std::vector<int> ref_latch(n, -1);
+		int ref_latches = 0;
+		for (auto &si : job.signal_list)
+			if (si.type == G(FF))
+				ref_latches++;
+		for (int i = 0; i < GetSize(latches); i++) {
+			int id = nets[latches[i].second].ref_id;
+			if (id < 0 || job.signal_list[id].type != G(FF) || ref_latch[id] >= 0)
+				break;
+			ref_latch[id] = i;
+			ref_latches--;
+		}
+		if (ref_latches != 0 || std::count(ref_latch.begin(), ref_latch.end(), -1) != n - GetSize(latches)) {
+			message = "ABC changed the flip-flops";
+			return ORLO_SIMCHECK_UNCHECKED;
+		}
+
+		for (int i = 0; i < GetSize(nodes); i++) {
+			if (nets[nodes[i].output].driver >= 0 || nets[nodes[i].output].input) {
+				message = stringf("net %d of output.blif has more than one driver", nodes[i].output);
+				return ORLO_SIMCHECK_MISMATCH;
+			}
+			nets[nodes[i].output].driver = i;
+		}
+
+		// The extracted logic has its loops broken already, an undriven
+		// signal (not an input) taints everything it drives.
+		std::vector<int> ref_order, out_order;
+		int inputs[4];
+		if (!orlo_topological_order(n, [&](int id, std::vector<int> &reads) {
+			int count = orlo_gate_inputs(job.signal_list[id], inputs);
+			reads.insert(reads.end(), inputs, inputs + count);
+		}, ref_order)) {
+			message = "the extracted logic has a loop";
+			return ORLO_SIMCHECK_UNCHECKED;
+		}
+		if (!orlo_topological_order(GetSize(nodes), [&](int id, std::vector<int> &reads) {
+			for (int in : nodes[id].inputs)
+				if (nets[in].driver >= 0)
+					reads.push_back(nets[in].driver);
+		}, out_order)) {
+			message = "output.blif has a combinational loop";
+			return ORLO_SIMCHECK_MISMATCH;
+		}
+
+		std::vector<bool> tainted(n);
+		std::vector<int> ref_random;
+		for (int id : ref_order) {
+			const gate_t &si = job.signal_list[id];
+			if (si.type == G(FF) || (si.type == G(NONE) && si.is_port && job.signal_bits[id].bit.wire != nullptr))
+				ref_random.push_back(id);
+			else if (si.type == G(NONE))
+				tainted[id] = job.signal_bits[id].bit.wire != nullptr;
+			else
+				for (int in : { si.in1, si.in2, si.in3, si.in4 })
+					if (in >= 0 && tainted[in])
+						tainted[id] = true;
+		}
+
+		// The points to compare: the outputs of the job and the inputs of
+		// its flip-flops, as the signal of the job and the net of output.blif
+		std::vector<std::pair<int, int>> points;
+		std::vector<int> ref_nets(n, -1);
+		for (int i = 0; i < GetSize(nets); i++)
+			if (nets[i].ref_id >= 0)
+				ref_nets[nets[i].ref_id] = i;
+		int skipped = 0;
+		for (auto &si : job.signal_list) {
+			int id = si.type == G(FF) ? si.in1 : si.id;
+			if (si.type == G(FF) ? id < 0 : !si.is_port || si.type == G(NONE))
+				continue;
+			if (tainted[id]) {
+				skipped++;
+				continue;
+			}
+			int out = si.type == G(FF) ? latches[ref_latch[si.id]].first : ref_nets[si.id];
+			if (out < 0 || (nets[out].driver < 0 && !nets[out].input)) {
+				message = stringf("%s is not driven in output.blif", ref_name(si.id).c_str());
+				return ORLO_SIMCHECK_MISMATCH;
+			}
+			points.push_back(std::make_pair(id, out));
+		}
+
+		std::vector<uint64_t> ref(n * W), out(GetSize(nets) * W);
+		int blocks = (vectors + 64 * W - 1) / (64 * W);
+		for (int block = 0; block < blocks; block++)
+		{
+			for (int id : ref_random)
+				for (int w = 0; w < W; w++)
+					ref[id * W + w] = random();
+			for (int id : ref_order) {
+				const gate_t &si = job.signal_list[id];
+				uint64_t *y = &ref[id * W];
+				if (si.type == G(NONE) && job.signal_bits[id].bit.wire == nullptr)
+					for (int w = 0; w < W; w++)
+						y[w] = job.signal_bits[id].bit == RTLIL::State::S1 ? ~uint64_t(0) : 0;
+				if (si.type == G(NONE) || si.type == G(FF))
+					continue;
+				const uint64_t *a = &ref[std::max(si.in1, 0) * W], *b = &ref[std::max(si.in2, 0) * W];
+				const uint64_t *c = &ref[std::max(si.in3, 0) * W], *d = &ref[std::max(si.in4, 0) * W];
+				for (int w = 0; w < W; w++)
+					y[w] = orlo_simulate_gate(si.type, a[w], b[w], c[w], d[w]);
+			}
+
+			// The inputs of output.blif are those of the job, the outputs
+			// of its latches those of the flip-flops
+			for (int i = 0; i < GetSize(nets); i++) {
+				if (!nets[i].input)
+					continue;
+				int id = nets[i].ref_id;
+				bool same = id >= 0 && (job.signal_list[id].type == G(FF) ||
+						(job.signal_list[id].is_port && job.signal_list[id].type == G(NONE)));
+				for (int w = 0; w < W; w++)
+					out[i * W + w] = same ? ref[id * W + w] : random();
+			}
+			for (int i : out_order) {
+				const node_t &node = nodes[i];
+				uint64_t *y = &out[node.output * W];
+				switch (node.kind)
+				{
+				case node_t::CONST:
+					for (int w = 0; w < W; w++)
+						y[w] = node.onset ? ~uint64_t(0) : 0;
+					break;
+				case node_t::GATE: {
+					int k = GetSize(node.inputs);
+					const uint64_t *a = &out[node.inputs[0] * W], *b = &out[node.inputs[std::min(1, k-1)] * W];
+					const uint64_t *c = &out[node.inputs[std::min(2, k-1)] * W], *d = &out[node.inputs[std::min(3, k-1)] * W];
+					for (int w = 0; w < W; w++)
+						y[w] = orlo_simulate_gate(node.type, a[w], b[w], c[w], d[w]);
+					break;
+				}
+				case node_t::MUXN:
+					for (int w = 0; w < W; w++) {
+						uint64_t level[16];
+						int width = 1 << node.selects;
+						for (int j = 0; j < width; j++)
+							level[j] = out[node.inputs[j] * W + w];
+						for (int s = 0; s < node.selects; s++) {
+							uint64_t sel = out[node.inputs[(1 << node.selects) + s] * W + w];
+							width /= 2;
+							for (int j = 0; j < width; j++)
+								level[j] = (level[2*j] & ~sel) | (level[2*j+1] & sel);
+						}
+						y[w] = level[0];
+					}
+					break;
+				case node_t::COVER:
+					for (int w = 0; w < W; w++)
+						y[w] = 0;
+					for (auto row : node.rows) {
+						uint64_t term[W];
+						for (int w = 0; w < W; w++)
+							term[w] = ~uint64_t(0);
+						for (int j = 0; j < GetSize(node.inputs); j++) {
+							if (row[j] == '-')
+								continue;
+							const uint64_t *in = &out[node.inputs[j] * W];
+							uint64_t invert = row[j] == '0' ? ~uint64_t(0) : 0;
+							for (int w = 0; w < W; w++)
+								term[w] &= in[w] ^ invert;
+						}
+						for (int w = 0; w < W; w++)
+							y[w] |= term[w];
+					}
+					if (!node.onset)
+						for (int w = 0; w < W; w++)
+							y[w] = ~y[w];
+					break;
+				}
+			}
+
+			for (auto &point : points)
+				for (int w = 0; w < W; w++) {
+					uint64_t diff = ref[point.first * W + w] ^ out[point.second * W + w];
+					if (diff == 0)
+						continue;
+					int lane = 0;
+					while ((diff & 1) == 0)
+						diff >>= 1, lane++;
+					message = stringf("%s differs on vector %d", ref_name(point.first).c_str(), (block * W + w) * 64 + lane);
+					return ORLO_SIMCHECK_MISMATCH;
+				}
+		}
+
+		message = stringf("%d vectors match on %d outputs", blocks * W * 64, GetSize(points));
+		if (skipped > 0)
+			message += stringf(", %d outputs that read undriven signals were skipped", skipped);
+		return ORLO_SIMCHECK_MATCH;
+	}
+};
+
+// -simcheck: check the loaded output of a job before it replaces the
+// extracted cells. Returns false if the cells have to stay, the loops are
+// undone then.
+bool orlo_simcheck_job(orlo_job_t &job, const orlo_blif_output_t &output, bool builtin_lib, int vectors)
+{
+	if (vectors <= 0 || !output.error.empty() || !output.missing.empty())
+		return true;
+
+	orlo_phase_timer_t timer;
+	orlo_simcheck_t simcheck(job, builtin_lib);
+	job.simcheck_result = simcheck.check(output, vectors);
+	job.phases[ORLO_PHASE_SIMCHECK].add(timer.stop());
+
+	if (job.simcheck_result == ORLO_SIMCHECK_MISMATCH) {
+		log_warning("Simulation check of %s failed: %s. Keeping the cells of the domain.\n",
+				job.tempdir_name.c_str(), simcheck.message.c_str());
+		orlo_undo_loops(job);
+		return false;
+	}
+	log("Simulation check: %s%s.\n", job.simcheck_result == ORLO_SIMCHECK_MATCH ? "" : "not checked, ", simcheck.message.c_str());
+	return true;
+}
+
+void orlo_simcheck_summary(RTLIL::Design *design, const std::deque<orlo_job_t> &jobs)
+{
+	int counts[ORLO_SIMCHECK_UNCHECKED + 1] = {};
+	for (auto &job : jobs)
+		counts[job.simcheck_result]++;
+	log("Simulation check: %d domains match, %d differ and keep their cells, %d not checked.\n",
+			counts[ORLO_SIMCHECK_MATCH], counts[ORLO_SIMCHECK_MISMATCH], counts[ORLO_SIMCHECK_UNCHECKED]);
+	design->scratchpad_set_int("orlo.simcheck_mismatches", counts[ORLO_SIMCHECK_MISMATCH]);
+}
+
+// -emit_only: the ABC command of every domain that needs to be mapped, one
+// per line, for a batch scheduler to run wherever it likes.
+void orlo_write_job_file(const std::string &topdir_name, const std::string &exe_file, const std::deque<orlo_job_t> &jobs)
+{
+	std::string filename = topdir_name + "/jobs";
+	std::ofstream f(filename);
+	int count = 0;
+	for (auto &job : jobs) {
+		if (job.count_output == 0 || job.reused)
+			continue;
+		f << orlo_abc_command(exe_file, job.tempdir_name + "/" + job.script_name,
+				"> " + job.tempdir_name + "/abc.log 2>&1") << "\n";
+		count++;
+	}
+	f.close();
+	if (!f)
+		log_error("Could not write the job file %s.\n", filename.c_str());
+	log("Wrote %d ABC jobs to %s.\n", count, filename.c_str());
+}
+
+// Turn a liberty file into ABC's binary SC library (.scl) and return its
+// name, or the name of the liberty file if that fails. The .scl goes to
+// scl_dir, named by a hash of the ABC executable and the name, size and
+// modification time of the liberty file, so that a copy from an earlier run
+// is used again as long as the liberty file is unchanged.
+std::string orlo_liberty_scl(const std::string &exe_file, const std::string &liberty_file, const std::string &scl_dir)
+{
+	struct stat st;
+	if (stat(liberty_file.c_str(), &st) != 0)
+		return liberty_file;
+
+	SHA1 sha;
+	sha.update(exe_file + "\n");
+	sha.update(stringf("%s %lld %lld\n", liberty_file.c_str(), (long long)st.st_size, (long long)st.st_mtime));
+	std::string scl_file = stringf("%s/%s.scl", scl_dir.c_str(), sha.final().c_str());
+	if (exists(scl_file)) {
+		log("Using %s for liberty file %s.\n", scl_file.c_str(), liberty_file.c_str());
+		return scl_file;
+	}
+
+	// As in the cache, the .scl is only renamed into place when complete.
+	std::string tmp = stringf("%s.%d.tmp", scl_file.c_str(), int(getpid()));
+	std::string tmp_scl = tmp + ".scl";
+	std::string script_file = tmp + ".script";
+	{
+		std::ofstream f(script_file);
+		f << stringf("read_lib -w %s; write_lib %s\n", liberty_file.c_str(), tmp_scl.c_str());
+	}
+	std::vector<std::string> output;
+	int ret = orlo_exec_abc(exe_file, script_file, [&](const std::string &line) { output.push_back(line); });
+	remove(script_file.c_str());
+	if (ret != 0 || !exists(tmp_scl)) {
+		log_warning("Converting liberty file %s to %s failed, ABC reads it as liberty:\n", liberty_file.c_str(), scl_file.c_str());
+		for (auto &line : output)
+			log("%s", line.c_str());
+		remove(tmp_scl.c_str());
+		return liberty_file;
+	}
+	rename(tmp_scl.c_str(), scl_file.c_str());
+	log("Converted liberty file %s to %s.\n", liberty_file.c_str(), scl_file.c_str());
+	return scl_file;
+}
+
+// Find "<key> = <number>" in a line of ABC's output.
+bool orlo_find_metric(const std::string &line, const char *key, double &value)
+{
+	for (size_t pos = line.find(key); pos != std::string::npos; pos = line.find(key, pos+1)) {
+		if (pos > 0 && isalnum((unsigned char)line[pos-1]))
+			continue;
+		const char *p = line.c_str() + pos + strlen(key);
+		while (*p == ' ')
+			p++;
+		if (*p != '=')
+			continue;
+		char *end;
+		double v = strtod(p+1, &end);
+		if (end == p+1)
+			continue;
+		value = v;
+		return true;
+	}
+	return false;
+}
+
+// Score a -strategies run by the last area and delay ABC reported, from
+// "stime" (Area = .. Delay = ..) or "print_stats" (area = .. delay = .., or
+// nd = .. lev = .. for LUT and SOP networks).
+void orlo_score_run(orlo_abc_run_t &run)
+{
+	for (auto &text : run.abc_output) {
+		std::string line = text;
+		std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+		double area, delay;
+		if (!orlo_find_metric(line, "area", area) && !orlo_find_metric(line, "nd", area))
+			continue;
+		run.area = area;
+		run.scored = true;
+		if (orlo_find_metric(line, "delay", delay) || orlo_find_metric(line, "lev", delay))
+			run.delay = delay;
+	}
+}
+
+std::string orlo_json_string(const std::string &str)
+{
+	std::string json = "\"";
+	for (unsigned char ch : str) {
+		if (ch == '"' || ch == '\\')
+			json += '\\', json += ch;
+		else if (ch < 0x20)
+			json += stringf("\\u%04x", ch);
+		else
+			json += ch;
+	}
+	return json + "\"";
+}
+
+// The state the runs of one job share in the scheduler. The first run that
+// gets to a job writes its files, the last one closes them.
+struct orlo_job_state_t
+{
+	std::mutex mutex;
+	std::unique_ptr<orlo_job_files_t> files;
+	bool prepared = false, ok = false;
+	int pending = 0;
+	// The runs of the job, and how many of them were started and are done.
+	// The latter are guarded by the mutex of the scheduler.
+	int runs = 0, started = 0, finished = 0;
+};
+
+// Write the netlist, the ABC scripts and the libraries of a job. Returns false
+// if there is nothing for ABC to do, then nothing is written.
+bool orlo_prepare_job(orlo_job_t &job, orlo_job_files_t &files, const orlo_abc_pool_t &pool)
+{
+	if (job.count_output == 0)
+		return false;
+	orlo_phase_timer_t timer;
+	std::string input_blif = orlo_input_blif(job);
+	bool ok = files.write("input.blif", input_blif);
+	std::vector<orlo_abc_run_t*> runs;
+	if (job.strategies.empty())
+		runs.push_back(&job);
+	for (auto &run : job.strategies)
+		runs.push_back(&run);
+	for (auto run : runs) {
+		std::string script = files.script(run->abc_script, run->output_name) + "\n";
+		ok = ok && files.write(run->script_name, script);
+		if (pool.enabled)
+			ok = ok && files.write(pool.script_name(*run), pool.script(script));
+	}
+	if (ok && job.inmem && job.library != nullptr)
+		ok = files.write(job.library->file_name(), job.library->text());
+	if (ok)
+		job.input_hash = orlo_cache_t::hash(input_blif);
+	job.phases[ORLO_PHASE_WRITE_BLIF].add(timer.stop());
+	return ok;
+}
+
+// Run ABC for one run of a job, unless the result is in the cache already.
+// This runs on the worker threads.
+void orlo_process_run(orlo_job_t &job, orlo_job_state_t &state, orlo_abc_run_t &run, const std::string &exe_file,
+		const orlo_cache_t &cache, const orlo_abc_pool_t &pool, orlo_abc_process_t &process, bool emit_only)
+{
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (!state.prepared) {
+			state.prepared = true;
+			state.files.reset(new orlo_job_files_t(job));
+			state.ok = orlo_prepare_job(job, *state.files, pool);
+		}
+	}
+
+#ifdef YOSYS_LINK_ABC
+	orlo_phase_timer_t timer;
+#else
+	orlo_phase_timer_t timer(true);
+#endif
+	if (state.ok && !emit_only && !cache.lookup(job, run, job.input_hash)) {
+		if (pool.enabled) {
+			// The process of the pool keeps running when a command fails,
+			// so a missing output.blif is what tells about it.
+			if (!job.inmem)
+				remove(run.output_blif.c_str());
+			orlo_run_abc_pool(job, run, exe_file, pool, process, state.files->path(pool.script_name(run)));
+		} else
+			orlo_run_abc(job, run, exe_file, state.files->path(run.script_name));
+		if (job.inmem)
+			run.output_text = state.files->read(run.output_name);
+		if (pool.enabled && run.abc_ret == 0 && (job.inmem ? run.output_text.empty() : !exists(run.output_blif)))
+			run.abc_ret = 1;
+		if (run.abc_ret == 0)
+			cache.store(job, run);
+	}
+	// Only the files in the abc work directory are compressed, not those
+	// in the cache
+	if (job.compress && state.ok && !emit_only && run.abc_ret == 0 &&
+			run.output_blif.compare(0, job.tempdir_name.size() + 1, job.tempdir_name + "/") == 0 &&
+			orlo_gzip_file(run.output_blif))
+		run.output_blif += ".gz";
+	if (!emit_only)
+		orlo_score_run(run);
+	orlo_phase_stats_t stats = timer.stop();
+
+	std::lock_guard<std::mutex> lock(state.mutex);
+	if (state.ok)
+		job.phases[ORLO_PHASE_ABC].add(stats);
+	if (--state.pending == 0) {
+		if (job.compress && state.ok && !emit_only)
+			orlo_gzip_file(state.files->path("input.blif"));
+		state.files.reset();
+	}
+}
+
+// Runs ABC for the jobs on worker threads while the main thread goes on
+// extracting, or reintegrates the jobs that are done. The jobs are
+// independent of each other, so the order in which they finish does not
+// matter. With -strategies every strategy of a job is a task of its own.
+// submit() waits while the queue of tasks is full. With the linked ABC there
+// are no worker threads, and the tasks are run on the main thread by wait().
+struct orlo_abc_scheduler_t
+{
+	struct task_t
+	{
+		orlo_job_t *job;
+		orlo_job_state_t *state;
+		orlo_abc_run_t *run;
+	};
+
+	const std::string &exe_file;
+	const orlo_cache_t &cache;
+	const orlo_abc_pool_t &pool;
+	size_t max_queued;
+	// The states are only added to by the main thread, a deque keeps the
+	// ones the workers point to in place.
+	std::deque<orlo_job_state_t> states;
+	std::map<const orlo_job_t*, orlo_job_state_t*> job_states;
+	std::mutex mutex;
+	std::condition_variable queue_cond, done_cond;
+	std::deque<task_t> queue;
+	std::vector<std::thread> workers;
+	orlo_abc_process_t process;
+	bool closed = false;
+	// -emit_only: only write the files of the jobs
+	bool emit_only;
+
+	// -progress: the main thread reports every progress_interval seconds
+	// while it submits jobs or waits for them. The counts are by domain and
+	// guarded by the mutex, running has the start time of every ABC run.
+	typedef std::chrono::steady_clock progress_clock_t;
+	double progress_interval = 0;
+	std::string status_file;
+	progress_clock_t::time_point first_start, next_report;
+	bool submitting = true;
+	int domains_submitted = 0, domains_started = 0, domains_done = 0;
+	long gates_submitted = 0, gates_done = 0;
+	std::map<const orlo_abc_run_t*, std::pair<const orlo_job_t*, progress_clock_t::time_point>> running;
+
+	orlo_abc_scheduler_t(const std::string &exe_file, const orlo_cache_t &cache, const orlo_abc_pool_t &pool, int nprocs,
+			bool emit_only) :
+			exe_file(exe_file), cache(cache), pool(pool), max_queued(2 * std::max(1, nprocs)), emit_only(emit_only)
+	{
+#ifdef YOSYS_LINK_ABC
+		// The linked ABC has global state and must not be entered twice,
+		// and it runs on the main thread.
+		nprocs = 0;
+#endif
+		if (nprocs > 1) {
+			log("Running ABC on %d worker threads.\n", nprocs);
+			log_flush();
+		}
+		for (int i = 0; i < nprocs; i++)
+			workers.emplace_back(&orlo_abc_scheduler_t::worker, this);
+	}
+
+	~orlo_abc_scheduler_t()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			queue.clear();
+		}
+		queue_cond.notify_all();
+		for (auto &worker : workers)
+			worker.join();
+	}
+
+	void set_progress(double interval, const std::string &filename)
+	{
+		progress_interval = interval;
+		status_file = filename;
+		next_report = progress_clock_t::now() + std::chrono::duration_cast<progress_clock_t::duration>(std::chrono::duration<double>(interval));
+	}
+
+	// With the mutex held, when a task is taken from the queue
+	void start(const task_t &task)
+	{
+		if (task.state->started++ == 0 && domains_started++ == 0)
+			first_start = progress_clock_t::now();
+		running[task.run] = std::make_pair(task.job, progress_clock_t::now());
+	}
+
+	void run(const task_t &task, orlo_abc_process_t &task_process)
+	{
+		orlo_process_run(*task.job, *task.state, *task.run, exe_file, cache, pool, task_process, emit_only);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running.erase(task.run);
+			if (++task.state->finished == task.state->runs) {
+				domains_done++;
+				gates_done += task.job->count_gates;
+			}
+		}
+		done_cond.notify_all();
+	}
+
+	// Wait on cond, but not past the next -progress report.
+	void wait_on(std::condition_variable &cond, std::unique_lock<std::mutex> &lock)
+	{
+		if (progress_interval <= 0) {
+			cond.wait(lock);
+			return;
+		}
+		if (cond.wait_until(lock, next_report) == std::cv_status::timeout) {
+			lock.unlock();
+			report();
+			lock.lock();
+		}
+	}
+
+	// -progress: log the domains that are pending, running and done, the
+	// throughput and the time left for the domains extracted so far, and
+	// write the same to the status file. This runs on the main thread.
+	void report(bool force = false)
+	{
+		if (progress_interval <= 0)
+			return;
+		progress_clock_t::time_point now = progress_clock_t::now();
+		if (!force && now < next_report)
+			return;
+		next_report = now + std::chrono::duration_cast<progress_clock_t::duration>(std::chrono::duration<double>(progress_interval));
+
+		int submitted, started, done;
+		long gates_left, gates;
+		std::vector<std::pair<double, const orlo_job_t*>> runs;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			submitted = domains_submitted, started = domains_started, done = domains_done;
+			gates = gates_done, gates_left = gates_submitted - gates_done;
+			for (auto &it : running)
+				runs.push_back(std::make_pair(std::chrono::duration<double>(now - it.second.second).count(), it.second.first));
+		}
+		std::sort(runs.begin(), runs.end(), [](const std::pair<double, const orlo_job_t*> &a,
+				const std::pair<double, const orlo_job_t*> &b) { return a.first > b.first; });
+
+		double elapsed = started > 0 ? std::chrono::duration<double>(now - first_start).count() : 0;
+		double rate = elapsed > 0 ? gates / elapsed : 0;
+		double eta = rate > 0 ? gates_left / rate : -1;
+		log("ABC progress: %d domains pending, %d running, %d done%s; %ld gates mapped, %.0f gates/s, %s left.\n",
+				submitted - started, started - done, done, submitting ? ", still extracting" : "", gates, rate,
+				eta < 0 ? "unknown time" : stringf("%.0fs", eta).c_str());
+		if (!runs.empty() && runs.front().first >= progress_interval)
+			log("ABC progress: the longest running domain is %s, for %.0fs.\n",
+					runs.front().second->tempdir_name.c_str(), runs.front().first);
+		log_flush();
+
+		if (status_file.empty())
+			return;
+		std::string json = "{\n";
+		json += stringf("  \"extracting\": %s,\n", submitting ? "true" : "false");
+		json += stringf("  \"domains\": {\"pending\": %d, \"running\": %d, \"done\": %d},\n",
+				submitted - started, started - done, done);
+		json += stringf("  \"gates\": {\"done\": %ld, \"pending\": %ld, \"per_second\": %.1f},\n", gates, gates_left, rate);
+		json += stringf("  \"eta_seconds\": %s,\n", eta < 0 ? "null" : stringf("%.1f", eta).c_str());
+		json += "  \"running\": [";
+		for (int i = 0; i < GetSize(runs); i++)
+			json += stringf("%s\n    {\"dir\": %s, \"gates\": %d, \"seconds\": %.1f}", i ? "," : "",
+					orlo_json_string(runs[i].second->tempdir_name).c_str(), runs[i].second->count_gates, runs[i].first);
+		json += runs.empty() ? "]\n}\n" : "\n  ]\n}\n";
+
+		// Renamed into place, so that a reader never sees half a file
+		std::string tmp = status_file + ".tmp";
+		std::ofstream f(tmp);
+		f << json;
+		f.close();
+		if (f.fail() || rename(tmp.c_str(), status_file.c_str()) != 0) {
+			log_warning("Could not write the status file %s, not writing it again.\n", status_file.c_str());
+			remove(tmp.c_str());
+			status_file.clear();
+		}
+	}
+
+	// No more jobs are submitted, the time left is the time left for all.
+	void finish_submitting()
+	{
+		submitting = false;
+	}
+
+	void worker()
+	{
+		orlo_abc_process_t worker_process;
+		while (1) {
+			task_t task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				queue_cond.wait(lock, [this]() { return closed || !queue.empty(); });
+				if (queue.empty())
+					return;
+				task = queue.front();
+				queue.pop_front();
+				start(task);
+			}
+			queue_cond.notify_all();
+			run(task, worker_process);
+		}
+	}
+
+	void submit(orlo_job_t &job)
+	{
+		states.emplace_back();
+		orlo_job_state_t &state = states.back();
+		job_states[&job] = &state;
+		if (job.reused || job.count_output == 0)
+			return;
+
+		std::vector<orlo_abc_run_t*> runs;
+		if (job.strategies.empty())
+			runs.push_back(&job);
+		for (auto &run : job.strategies)
+			runs.push_back(&run);
+		state.pending = GetSize(runs);
+		state.runs = GetSize(runs);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		domains_submitted++;
+		gates_submitted += job.count_gates;
+		for (auto run : runs) {
+			while (!workers.empty() && queue.size() >= max_queued)
+				wait_on(queue_cond, lock);
+			queue.push_back(task_t{ &job, &state, run });
+		}
+		lock.unlock();
+		queue_cond.notify_all();
+		report();
+	}
+
+	// Wait until all runs of a submitted job are done.
+	void wait(const orlo_job_t &job)
+	{
+		orlo_job_state_t &state = *job_states.at(&job);
+		std::unique_lock<std::mutex> lock(mutex);
+		while (state.finished < state.runs) {
+			if (workers.empty()) {
+				task_t task = queue.front();
+				queue.pop_front();
+				start(task);
+				lock.unlock();
+				run(task, process);
+				report();
+				lock.lock();
+				continue;
+			}
+			wait_on(done_cond, lock);
+		}
+	}
+};
+
+// Pick the best run of a -strategies job by area or delay, the other metric
+// and then the order of the strategies break ties. Runs that failed or did not
+// report their area lose against all others. The winner is moved into the job
+// and, in the abc work directory, to output.blif for orlo_reint.
+std::tuple<bool, bool, double, double> orlo_strategy_rank(const orlo_job_t &job, const orlo_abc_run_t &run, bool by_delay)
+{
+	bool valid = run.abc_ret == 0 && (run.cache_hit || !job.inmem || !run.output_text.empty());
+	return std::make_tuple(!valid, !run.scored, by_delay ? run.delay : run.area, by_delay ? run.area : run.delay);
+}
+
+void orlo_select_strategy(orlo_job_t &job, bool by_delay)
+{
+	int best = 0;
+	for (int i = 0; i < GetSize(job.strategies); i++) {
+		const orlo_abc_run_t &run = job.strategies[i];
+		if (run.abc_ret != 0)
+			log("Strategy %d failed (return code %d): %s\n", i, run.abc_ret, run.strategy.c_str());
+		else if (!run.scored)
+			log("Strategy %d has no area: %s\n", i, run.strategy.c_str());
+		else
+			log("Strategy %d: area %.2f, delay %.2f: %s\n", i, run.area, run.delay, run.strategy.c_str());
+		if (orlo_strategy_rank(job, run, by_delay) < orlo_strategy_rank(job, job.strategies[best], by_delay))
+			best = i;
+	}
+	log("Using strategy %d.\n", best);
+
+	orlo_abc_run_t &winner = job.strategies[best];
+	std::string suffix = is_gz(winner.output_blif) ? ".gz" : "";
+	std::string output_blif = job.tempdir_name + "/output.blif" + suffix;
+	if (!job.inmem && winner.output_blif == job.tempdir_name + "/" + winner.output_name + suffix &&
+			rename(winner.output_blif.c_str(), output_blif.c_str()) == 0)
+		winner.output_blif = output_blif;
+	static_cast<orlo_abc_run_t&>(job) = std::move(winner);
+	job.strategies.clear();
+}
+
+// -refine: map the domains that limit the timing a second time, once all
+// of them are mapped. A domain whose delay is within percent of the worst
+// one gets a run with {D} set to a target percent below its own delay, a
+// target below the worst delay would be met already by the faster domains.
+// The first run is put in front of it in job.strategies, so that
+// orlo_select_strategy() takes the faster of the two.
+void orlo_refine_delays(std::deque<orlo_job_t> &jobs, orlo_abc_scheduler_t &scheduler, int percent)
+{
+	double worst = 0;
+	for (auto &job : jobs) {
+		scheduler.wait(job);
+		if (job.count_output > 0 && job.abc_ret == 0 && job.scored)
+			worst = std::max(worst, job.delay);
+	}
+	if (worst <= 0) {
+		log("Delay refinement: no domain reported a delay.\n");
+		return;
+	}
+
+	double threshold = worst * (1 - percent / 100.0);
+	std::vector<orlo_job_t*> refined;
+	for (auto &job : jobs) {
+		if (job.count_output == 0 || job.abc_ret != 0 || !job.scored || job.delay < threshold)
+			continue;
+		if (job.delay_script.empty()) {
+			log("Delay refinement: the script of %s has no {D}, it is not refined.\n", job.tempdir_name.c_str());
+			continue;
+		}
+		double target = std::min(job.delay, worst) * (1 - percent / 100.0);
+		log("Delay refinement: %s has delay %.2f, mapping it again with -D %g.\n", job.tempdir_name.c_str(), job.delay, target);
+		orlo_abc_run_t run;
+		run.strategy = stringf("-D %g", target);
+		run.script_name = "abc_refine.script";
+		run.output_name = "output_refine.blif";
+		run.abc_script = orlo_finish_script(orlo_delay_script(job.delay_script, run.strategy), job.tempdir_name, run.output_name);
+		run.output_blif = job.tempdir_name + "/" + run.output_name;
+		job.strategies.push_back(std::move(run));
+		scheduler.submit(job);
+		refined.push_back(&job);
+	}
+	log("Delay refinement: %d domains are within %d%% of the worst delay %.2f.\n", GetSize(refined), percent, worst);
+
+	int faster = 0;
+	for (auto job : refined) {
+		scheduler.wait(*job);
+		orlo_abc_run_t first = std::move(static_cast<orlo_abc_run_t&>(*job));
+		first.strategy = "first mapping";
+		job->refined = orlo_strategy_rank(*job, job->strategies.front(), true) < orlo_strategy_rank(*job, first, true);
+		if (job->refined)
+			faster++;
+		job->strategies.insert(job->strategies.begin(), std::move(first));
+	}
+	log("Delay refinement: %d of %d domains got faster.\n", faster, GetSize(refined));
+}
+
+// Log ABC's output and reintegrate its results. The jobs are finished in the
+// order they were extracted, so the result does not depend on the number of
+// worker threads.
+void orlo_module_finish(RTLIL::Design *design, orlo_job_t &job, const std::vector<std::string> &liberty_files,
+		const std::vector<std::string> &genlib_files, bool show_tempdir, bool sop_mode, bool by_delay,
+		int simcheck)
+{
+	if (!job.error.empty())
+		log_error("%s", job.error.c_str());
+
+	if (job.count_output == 0)
+		return;
+
+	// A pool process that could not be started fails every run the same way,
+	// another strategy must not hide it.
+	if (!job.start_error.empty())
+		log_error("%s", job.start_error.c_str());
+	for (auto &run : job.strategies)
+		if (!run.start_error.empty())
+			log_error("%s", run.start_error.c_str());
+
+	log_push();
+	log_header(design, "Executing ABC.\n");
+
+	if (!job.strategies.empty())
+		orlo_select_strategy(job, by_delay);
+
+	std::string buffer = job.abc_command;
+	if (job.reused)
+		log("Using the ABC result of the previous run, the logic did not change.\n");
+	else if (job.cache_hit)
+		log("Using cached ABC result %s.\n", job.cache_key.c_str());
+	else
+		log("Running ABC command: %s\n", replace_tempdir(buffer, job.tempdir_name, show_tempdir).c_str());
+	for (auto &line : job.abc_output)
+		log("ABC: %s\n", replace_tempdir(line, job.tempdir_name, show_tempdir).c_str());
+	job.abc_output.clear();
+
+	if (job.abc_ret != 0)
+		log_error("ABC: execution of command \"%s\" failed: return code %d.\n", buffer.c_str(), job.abc_ret);
+
+	orlo_blif_output_t output;
+	orlo_load_output(job, output);
+	if (orlo_simcheck_job(job, output, liberty_files.empty() && genlib_files.empty(), simcheck)) {
+		// -simcheck: the cells were kept until now
+		if (simcheck > 0)
+			for (auto cell : job.extracted_cells)
+				job.module->remove(cell);
+		orlo_reintegrate(design, job, output, liberty_files, genlib_files, sop_mode);
+	}
+	log_pop();
+}
+
+std::string orlo_json_phase(const orlo_phase_stats_t &stats)
+{
+	return stringf("{\"wall\": %.6f, \"cpu\": %.6f, \"peak_rss_kb\": %ld}", stats.wall, stats.cpu, stats.peak_rss_kb);
+}
+
+// Write the -stats report: the clock domain partitioning of every module, and
+// the size and the phases of every job in extraction order.
+void orlo_write_stats(const std::string &filename, const std::vector<std::pair<RTLIL::IdString, orlo_phase_stats_t>> &partitions,
+		const std::deque<orlo_job_t> &jobs, const orlo_phase_stats_t &total)
+{
+	std::ofstream f(filename);
+	if (f.fail())
+		log_error("Can't open stats file `%s' for writing: %s\n", filename.c_str(), strerror(errno));
+
+	f << "{\n";
+	f << "  \"partition\": [";
+	for (int i = 0; i < GetSize(partitions); i++)
+		f << (i ? ",\n    " : "\n    ") << stringf("{\"module\": %s, \"time\": %s}",
+				orlo_json_string(log_id(partitions[i].first)).c_str(), orlo_json_phase(partitions[i].second).c_str());
+	f << "\n  ],\n";
+	f << "  \"jobs\": [";
+	for (int i = 0; i < GetSize(jobs); i++) {
+		const orlo_job_t &job = jobs[i];
+		f << (i ? ",\n" : "\n") << "    {\n";
+		f << stringf("      \"module\": %s,\n", orlo_json_string(log_id(job.module)).c_str());
+		f << stringf("      \"domain\": %d,\n", job.clk_domain);
+		f << stringf("      \"clock\": %s,\n", job.clk_sig.empty() ? "null" : orlo_json_string(stringf("%s%s",
+				job.clk_polarity ? "" : "!", log_signal(job.clk_sig))).c_str());
+		f << stringf("      \"gates\": %d,\n", job.count_gates);
+		f << stringf("      \"inputs\": %d,\n", job.count_input);
+		f << stringf("      \"outputs\": %d,\n", job.count_output);
+		f << stringf("      \"cache_hit\": %s,\n", job.cache_hit ? "true" : "false");
+		f << stringf("      \"area\": %s,\n", job.scored ? stringf("%g", job.area).c_str() : "null");
+		f << stringf("      \"delay\": %s,\n", job.scored ? stringf("%g", job.delay).c_str() : "null");
+		f << stringf("      \"refined\": %s,\n", job.refined ? "true" : "false");
+		f << "      \"phases\": {";
+		for (int k = 0; k < ORLO_PHASE_COUNT; k++)
+			f << (k ? ",\n        " : "\n        ") << stringf("\"%s\": %s", orlo_phase_names[k], orlo_json_phase(job.phases[k]).c_str());
+		f << "\n      }\n";
+		f << "    }";
+	}
+	f << "\n  ],\n";
+	f << stringf("  \"total\": %s\n", orlo_json_phase(total).c_str());
+	f << "}\n";
+
+	f.close();
+	if (f.fail())
+		log_error("Writing stats file `%s' failed: %s\n", filename.c_str(), strerror(errno));
+	log("Wrote timing and memory statistics to `%s'.\n", filename.c_str());
+}
+
+typedef tuple<bool, RTLIL::SigSpec, bool, RTLIL::SigSpec> clkdomain_t;
+
+// Partition the cells of a module into clock domains for -dff. Every flip-flop
+// starts the domain of its clock and enable. The domains are grown one level
+// towards the loads of the flip-flops and from there on towards the drivers,
+// and then to everything connected to them. Cells not reached from any
+// flip-flop get a domain without a clock.
+//
+// The cells and bits are numbered densely and the incidence is kept in flat
+// arrays by cell and by bit. A bit is expanded at most once in every
+// direction, so this is linear in the number of connections. Where two
+// domains reach a cell at the same level, the order of the cells in the
+// module decides, so orlo and orlo_reint always agree on the partition.
+std::map<clkdomain_t, std::vector<RTLIL::Cell*>> orlo_clock_domains(RTLIL::Design *design, RTLIL::Module *mod,
+		const std::vector<RTLIL::Cell*> &all_cells)
+{
+	enum { CONN_INPUT = 1, CONN_OUTPUT = 2 };
+
+	CellTypes ct(design);
+	SigMap assign_map(mod);
+	int ncells = GetSize(all_cells);
+
+	orlo_signal_map_t bit_index;
+	int nbits = 0;
+	std::vector<int> cell_begin(ncells+1), conn_bit;
+	std::vector<char> conn_dir;
+
+	std::vector<clkdomain_t> domain_keys;
+	std::map<clkdomain_t, int> domain_ids;
+	std::vector<int> cell_domain(ncells, -1);
+	std::vector<int> assigned;
+
+	for (int i = 0; i < ncells; i++)
+	{
+		RTLIL::Cell *cell = all_cells[i];
+		cell_begin[i] = GetSize(conn_bit);
+
+		for (auto &conn : cell->connections()) {
+			char dir = (ct.cell_input(cell->type, conn.first) ? CONN_INPUT : 0) |
+					(ct.cell_output(cell->type, conn.first) ? CONN_OUTPUT : 0);
+			for (auto bit : assign_map(conn.second)) {
+				if (bit.wire == nullptr)
+					continue;
+				int &idx = bit_index[bit];
+				if (idx < 0)
+					idx = nbits++;
+				conn_bit.push_back(idx);
+				conn_dir.push_back(dir);
+			}
+		}
+
+		clkdomain_t key;
+		if (cell->type.in(ID($_DFF_N_), ID($_DFF_P_)))
+		{
+			key = clkdomain_t(cell->type == ID($_DFF_P_), assign_map(cell->getPort(ID::C)), true, RTLIL::SigSpec());
+		}
+		else
+		if (cell->type.in(ID($_DFFE_NN_), ID($_DFFE_NP_), ID($_DFFE_PN_), ID($_DFFE_PP_)))
+		{
+			bool this_clk_pol = cell->type.in(ID($_DFFE_PN_), ID($_DFFE_PP_));
+			bool this_en_pol = cell->type.in(ID($_DFFE_NP_), ID($_DFFE_PP_));
+			key = clkdomain_t(this_clk_pol, assign_map(cell->getPort(ID::C)), this_en_pol, assign_map(cell->getPort(ID::E)));
+		}
+		else
 			continue;
-		fprintf(f, " ys__n%d", si.id);
-		pi_map[count_input++] = log_signal(si.bit);
+
+		auto it = domain_ids.find(key);
+		if (it == domain_ids.end()) {
+			it = domain_ids.insert(std::make_pair(key, GetSize(domain_keys))).first;
+			domain_keys.push_back(key);
+		}
+		cell_domain[i] = it->second;
+		assigned.push_back(i);
 	}
-	if (count_input == 0)
-		fprintf(f, " dummy_input\n");
-	fprintf(f, "\n");
+	cell_begin[ncells] = GetSize(conn_bit);
+	bit_index.clear();
+
+	// The same incidence by bit
+	std::vector<int> bit_begin(nbits+1), bit_cell(conn_bit.size());
+	std::vector<char> bit_dir(conn_bit.size());
+	for (int bit : conn_bit)
+		bit_begin[bit+1]++;
+	for (int bit = 0; bit < nbits; bit++)
+		bit_begin[bit+1] += bit_begin[bit];
+	std::vector<int> bit_fill(bit_begin.begin(), bit_begin.end() - 1);
+	for (int i = 0; i < ncells; i++)
+		for (int k = cell_begin[i]; k < cell_begin[i+1]; k++) {
+			int pos = bit_fill[conn_bit[k]]++;
+			bit_cell[pos] = i;
+			bit_dir[pos] = conn_dir[k];
+		}
 
-	int count_output = 0;
-	fprintf(f, ".outputs");
-	for (auto &si : signal_list) {
-		if (!si.is_port || si.type == G(NONE))
-			continue;
-		fprintf(f, " ys__n%d", si.id);
-		po_map[count_output++] = log_signal(si.bit);
-	}
-	fprintf(f, "\n");
-
-	for (auto &si : signal_list)
-		fprintf(f, "# ys__n%-5d %s\n", si.id, log_signal(si.bit));
-
-	for (auto &si : signal_list) {
-		if (si.bit.wire == nullptr) {
-			fprintf(f, ".names ys__n%d\n", si.id);
-			if (si.bit == RTLIL::State::S1)
-				fprintf(f, "1\n");
-		}
-	}
-
-	int count_gates = 0;
-	for (auto &si : signal_list) {
-		if (si.type == G(BUF)) {
-			fprintf(f, ".names ys__n%d ys__n%d\n", si.in1, si.id);
-			fprintf(f, "1 1\n");
-		} else if (si.type == G(NOT)) {
-			fprintf(f, ".names ys__n%d ys__n%d\n", si.in1, si.id);
-			fprintf(f, "0 1\n");
-		} else if (si.type == G(AND)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "11 1\n");
-		} else if (si.type == G(NAND)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "0- 1\n");
-			fprintf(f, "-0 1\n");
-		} else if (si.type == G(OR)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "-1 1\n");
-			fprintf(f, "1- 1\n");
-		} else if (si.type == G(NOR)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "00 1\n");
-		} else if (si.type == G(XOR)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "01 1\n");
-			fprintf(f, "10 1\n");
-		} else if (si.type == G(XNOR)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "00 1\n");
-			fprintf(f, "11 1\n");
-		} else if (si.type == G(ANDNOT)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "10 1\n");
-		} else if (si.type == G(ORNOT)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.id);
-			fprintf(f, "1- 1\n");
-			fprintf(f, "-0 1\n");
-		} else if (si.type == G(MUX)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.id);
-			fprintf(f, "1-0 1\n");
-			fprintf(f, "-11 1\n");
-		} else if (si.type == G(NMUX)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.id);
-			fprintf(f, "0-0 1\n");
-			fprintf(f, "-01 1\n");
-		} else if (si.type == G(AOI3)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.id);
-			fprintf(f, "-00 1\n");
-			fprintf(f, "0-0 1\n");
-		} else if (si.type == G(OAI3)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.id);
-			fprintf(f, "00- 1\n");
-			fprintf(f, "--0 1\n");
-		} else if (si.type == G(AOI4)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.in4, si.id);
-			fprintf(f, "-0-0 1\n");
-			fprintf(f, "-00- 1\n");
-			fprintf(f, "0--0 1\n");
-			fprintf(f, "0-0- 1\n");
-		} else if (si.type == G(OAI4)) {
-			fprintf(f, ".names ys__n%d ys__n%d ys__n%d ys__n%d ys__n%d\n", si.in1, si.in2, si.in3, si.in4, si.id);
-			fprintf(f, "00-- 1\n");
-			fprintf(f, "--00 1\n");
-		} else if (si.type == G(FF)) {
-			if (si.init == State::S0 || si.init == State::S1) {
-				fprintf(f, ".latch ys__n%d ys__n%d %d\n", si.in1, si.id, si.init == State::S1 ? 1 : 0);
-				recover_init = true;
-			} else
-				fprintf(f, ".latch ys__n%d ys__n%d 2\n", si.in1, si.id);
-		} else if (si.type != G(NONE))
-			log_abort();
-		if (si.type != G(NONE))
-			count_gates++;
+	// Assign the unassigned cells on the `from_dir' side of the `to_dir'
+	// connections of a cell to its domain.
+	auto expand = [&](int cell, char to_dir, char from_dir, std::vector<bool> &bit_done, std::vector<int> &queue) {
+		for (int k = cell_begin[cell]; k < cell_begin[cell+1]; k++) {
+			int bit = conn_bit[k];
+			if ((conn_dir[k] & to_dir) == 0 || bit_done[bit])
+				continue;
+			bit_done[bit] = true;
+			for (int pos = bit_begin[bit]; pos < bit_begin[bit+1]; pos++) {
+				int c = bit_cell[pos];
+				if ((bit_dir[pos] & from_dir) == 0 || cell_domain[c] >= 0)
+					continue;
+				cell_domain[c] = cell_domain[cell];
+				assigned.push_back(c);
+				queue.push_back(c);
+			}
+		}
+	};
+
+	// Towards the drivers, and one level towards the loads. The cells found
+	// on either side are only expanded towards their drivers.
+	std::vector<int> queue_up(assigned), queue_down(assigned), next_queue_up;
+	std::vector<bool> bit_done_up(nbits), bit_done_down(nbits);
+	size_t up = 0, down = 0;
+	while (up < queue_up.size() || down < queue_down.size())
+	{
+		if (up < queue_up.size())
+			expand(queue_up[up++], CONN_INPUT, CONN_OUTPUT, bit_done_up, next_queue_up);
+		if (down < queue_down.size())
+			expand(queue_down[down++], CONN_OUTPUT, CONN_INPUT, bit_done_down, next_queue_up);
+
+		if (up == queue_up.size() && down == queue_down.size()) {
+			queue_up.swap(next_queue_up);
+			next_queue_up.clear();
+			queue_down.clear();
+			up = down = 0;
+		}
 	}
 
-	fprintf(f, ".end\n");
-	fclose(f);
+	// Then to everything that is connected, breadth first
+	std::vector<int> queue(assigned);
+	std::vector<bool> bit_done(nbits);
+	for (size_t i = 0; i < queue.size(); i++)
+		expand(queue[i], CONN_INPUT | CONN_OUTPUT, CONN_INPUT | CONN_OUTPUT, bit_done, queue);
 
-	log("Extracted %d gates and %d wires to a netlist network with %d inputs and %d outputs.\n",
-			count_gates, GetSize(signal_list), count_input, count_output);
-	log_push();
-	if (count_output > 0)
-	{
-		log_header(design, "Executing ABC.\n");
+	std::vector<std::vector<RTLIL::Cell*>> domain_cells(domain_keys.size());
+	for (int c : assigned)
+		domain_cells[cell_domain[c]].push_back(all_cells[c]);
 
-		auto &cell_cost = cmos_cost ? CellCosts::cmos_gate_cost() : CellCosts::default_gate_cost();
+	std::map<clkdomain_t, std::vector<RTLIL::Cell*>> assigned_cells;
+	for (int i = 0; i < GetSize(domain_keys); i++)
+		assigned_cells[domain_keys[i]].swap(domain_cells[i]);
 
-		buffer = stringf("%s/stdcells.genlib", tempdir_name.c_str());
-		f = fopen(buffer.c_str(), "wt");
-		if (f == nullptr)
-			log_error("Opening %s for writing failed: %s\n", buffer.c_str(), strerror(errno));
-		fprintf(f, "GATE ZERO    1 Y=CONST0;\n");
-		fprintf(f, "GATE ONE     1 Y=CONST1;\n");
-		fprintf(f, "GATE BUF    %d Y=A;                  PIN * NONINV  1 999 1 0 1 0\n", cell_cost.at(ID($_BUF_)));
-		fprintf(f, "GATE NOT    %d Y=!A;                 PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_NOT_)));
-		if (enabled_gates.count("AND"))
-			fprintf(f, "GATE AND    %d Y=A*B;                PIN * NONINV  1 999 1 0 1 0\n", cell_cost.at(ID($_AND_)));
-		if (enabled_gates.count("NAND"))
-			fprintf(f, "GATE NAND   %d Y=!(A*B);             PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_NAND_)));
-		if (enabled_gates.count("OR"))
-			fprintf(f, "GATE OR     %d Y=A+B;                PIN * NONINV  1 999 1 0 1 0\n", cell_cost.at(ID($_OR_)));
-		if (enabled_gates.count("NOR"))
-			fprintf(f, "GATE NOR    %d Y=!(A+B);             PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_NOR_)));
-		if (enabled_gates.count("XOR"))
-			fprintf(f, "GATE XOR    %d Y=(A*!B)+(!A*B);      PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_XOR_)));
-		if (enabled_gates.count("XNOR"))
-			fprintf(f, "GATE XNOR   %d Y=(A*B)+(!A*!B);      PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_XNOR_)));
-		if (enabled_gates.count("ANDNOT"))
-			fprintf(f, "GATE ANDNOT %d Y=A*!B;               PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_ANDNOT_)));
-		if (enabled_gates.count("ORNOT"))
-			fprintf(f, "GATE ORNOT  %d Y=A+!B;               PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_ORNOT_)));
-		if (enabled_gates.count("AOI3"))
-			fprintf(f, "GATE AOI3   %d Y=!((A*B)+C);         PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_AOI3_)));
-		if (enabled_gates.count("OAI3"))
-			fprintf(f, "GATE OAI3   %d Y=!((A+B)*C);         PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_OAI3_)));
-		if (enabled_gates.count("AOI4"))
-			fprintf(f, "GATE AOI4   %d Y=!((A*B)+(C*D));     PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_AOI4_)));
-		if (enabled_gates.count("OAI4"))
-			fprintf(f, "GATE OAI4   %d Y=!((A+B)*(C+D));     PIN * INV     1 999 1 0 1 0\n", cell_cost.at(ID($_OAI4_)));
-		if (enabled_gates.count("MUX"))
-			fprintf(f, "GATE MUX    %d Y=(A*B)+(S*B)+(!S*A); PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_MUX_)));
-		if (enabled_gates.count("NMUX"))
-			fprintf(f, "GATE NMUX   %d Y=!((A*B)+(S*B)+(!S*A)); PIN * UNKNOWN 1 999 1 0 1 0\n", cell_cost.at(ID($_NMUX_)));
-		if (map_mux4)
-			fprintf(f, "GATE MUX4   %d Y=(!S*!T*A)+(S*!T*B)+(!S*T*C)+(S*T*D); PIN * UNKNOWN 1 999 1 0 1 0\n", 2*cell_cost.at(ID($_MUX_)));
-		if (map_mux8)
-			fprintf(f, "GATE MUX8   %d Y=(!S*!T*!U*A)+(S*!T*!U*B)+(!S*T*!U*C)+(S*T*!U*D)+(!S*!T*U*E)+(S*!T*U*F)+(!S*T*U*G)+(S*T*U*H); PIN * UNKNOWN 1 999 1 0 1 0\n", 4*cell_cost.at(ID($_MUX_)));
-		if (map_mux16)
-			fprintf(f, "GATE MUX16  %d Y=(!S*!T*!U*!V*A)+(S*!T*!U*!V*B)+(!S*T*!U*!V*C)+(S*T*!U*!V*D)+(!S*!T*U*!V*E)+(S*!T*U*!V*F)+(!S*T*U*!V*G)+(S*T*U*!V*H)+(!S*!T*!U*V*I)+(S*!T*!U*V*J)+(!S*T*!U*V*K)+(S*T*!U*V*L)+(!S*!T*U*V*M)+(S*!T*U*V*N)+(!S*T*U*V*O)+(S*T*U*V*P); PIN * UNKNOWN 1 999 1 0 1 0\n", 8*cell_cost.at(ID($_MUX_)));
-		fclose(f);
+	clkdomain_t key(true, RTLIL::SigSpec(), true, RTLIL::SigSpec());
+	for (int i = 0; i < ncells; i++)
+		if (cell_domain[i] < 0)
+			assigned_cells[key].push_back(all_cells[i]);
 
-		if (!lut_costs.empty()) {
-			buffer = stringf("%s/lutdefs.txt", tempdir_name.c_str());
-			f = fopen(buffer.c_str(), "wt");
-			if (f == nullptr)
-				log_error("Opening %s for writing failed: %s\n", buffer.c_str(), strerror(errno));
-			for (int i = 0; i < GetSize(lut_costs); i++)
-				fprintf(f, "%d %d.00 1.00\n", i+1, lut_costs.at(i));
-			fclose(f);
-		}
+	log_header(design, "Summary of detected clock domains:\n");
+	for (auto &it : assigned_cells)
+		log("  %d cells in clk=%s%s, en=%s%s\n", GetSize(it.second),
+				std::get<0>(it.first) ? "" : "!", log_signal(std::get<1>(it.first)),
+				std::get<2>(it.first) ? "" : "!", log_signal(std::get<3>(it.first)));
 
-		buffer = stringf("%s -s -f %s/abc.script 2>&1", exe_file.c_str(), tempdir_name.c_str());
-		log("Running ABC command: %s\n", replace_tempdir(buffer, tempdir_name, show_tempdir).c_str());
+	return assigned_cells;
+}
 
-#ifndef YOSYS_LINK_ABC
-		abc_output_filter filt(tempdir_name, show_tempdir);
-		int ret = run_command(buffer, std::bind(&abc_output_filter::next_line, filt, std::placeholders::_1));
-#else
-		// These needs to be mutable, supposedly due to getopt
-		char *abc_argv[5];
-		string tmp_script_name = stringf("%s/abc.script", tempdir_name.c_str());
-		abc_argv[0] = strdup(exe_file.c_str());
-		abc_argv[1] = strdup("-s");
-		abc_argv[2] = strdup("-f");
-		abc_argv[3] = strdup(tmp_script_name.c_str());
-		abc_argv[4] = 0;
-		int ret = Abc_RealMain(4, abc_argv);
-		free(abc_argv[0]);
-		free(abc_argv[1]);
-		free(abc_argv[2]);
-		free(abc_argv[3]);
-#endif
-		if (ret != 0)
-			log_error("ABC: execution of command \"%s\" failed: return code %d.\n", buffer.c_str(), ret);
+// -max_gates: split a domain with more than max_gates cells into balanced
+// parts that are mapped as jobs of their own. The cells are ordered breadth
+// first along their connections, starting from the first cell in the module
+// order, and this order is cut into equal pieces, so connected logic mostly
+// ends up in the same part. Nets with a large fanout, like clocks, enables
+// and resets, would pull unrelated cells together and are not followed. The
+// signals between the parts become ports of the jobs, like every signal that
+// is used outside of a job. This only depends on the cells and their order,
+// so orlo and orlo_reint split a domain the same way.
+std::vector<std::vector<RTLIL::Cell*>> orlo_split_cells(RTLIL::Module *mod, const std::vector<RTLIL::Cell*> &cells, int max_gates)
+{
+	const int max_fanout = 64;
 
-		orlo_reintegrate(design, module, liberty_files, genlib_files, sop_mode, tempdir_name);
-    }
-	else
-	{
-		log("Don't call ABC as there is nothing to map.\n");
+	std::vector<std::vector<RTLIL::Cell*>> parts;
+	int ncells = GetSize(cells);
+	if (max_gates <= 0 || ncells <= max_gates) {
+		parts.push_back(cells);
+		return parts;
 	}
 
-    // I've kinda lost track of where I should put the cleanup and
-    
-    /*
-	if (cleanup)
-	{
-		log("Removing temp directory.\n");
-		remove_directory(tempdir_name);
+	SigMap assign_map(mod);
+	orlo_signal_map_t bit_index;
+	int nbits = 0;
+	std::vector<int> cell_begin(ncells+1), conn_bit;
+	for (int i = 0; i < ncells; i++) {
+		cell_begin[i] = GetSize(conn_bit);
+		for (auto &conn : cells[i]->connections())
+			for (auto bit : assign_map(conn.second)) {
+				if (bit.wire == nullptr)
+					continue;
+				int &idx = bit_index[bit];
+				if (idx < 0)
+					idx = nbits++;
+				conn_bit.push_back(idx);
+			}
+	}
+	cell_begin[ncells] = GetSize(conn_bit);
+	bit_index.clear();
+
+	std::vector<int> bit_begin(nbits+1), bit_cell(conn_bit.size());
+	for (int bit : conn_bit)
+		bit_begin[bit+1]++;
+	for (int bit = 0; bit < nbits; bit++)
+		bit_begin[bit+1] += bit_begin[bit];
+	std::vector<int> bit_fill(bit_begin.begin(), bit_begin.end() - 1);
+	for (int i = 0; i < ncells; i++)
+		for (int k = cell_begin[i]; k < cell_begin[i+1]; k++)
+			bit_cell[bit_fill[conn_bit[k]]++] = i;
+
+	std::vector<int> order;
+	order.reserve(ncells);
+	std::vector<bool> cell_done(ncells), bit_done(nbits);
+	for (int seed = 0; seed < ncells; seed++) {
+		if (cell_done[seed])
+			continue;
+		cell_done[seed] = true;
+		size_t i = order.size();
+		order.push_back(seed);
+		for (; i < order.size(); i++) {
+			int cell = order[i];
+			for (int k = cell_begin[cell]; k < cell_begin[cell+1]; k++) {
+				int bit = conn_bit[k];
+				if (bit_done[bit] || bit_begin[bit+1] - bit_begin[bit] > max_fanout)
+					continue;
+				bit_done[bit] = true;
+				for (int pos = bit_begin[bit]; pos < bit_begin[bit+1]; pos++)
+					if (!cell_done[bit_cell[pos]]) {
+						cell_done[bit_cell[pos]] = true;
+						order.push_back(bit_cell[pos]);
+					}
+			}
+		}
 	}
 
-	log_pop();
-    */
+	int nparts = (ncells + max_gates - 1) / max_gates;
+	std::vector<int> cell_part(ncells);
+	for (int i = 0; i < ncells; i++)
+		cell_part[order[i]] = int((long long)i * nparts / ncells);
+
+	// Within a part the cells stay in the module order
+	parts.resize(nparts);
+	for (int i = 0; i < ncells; i++)
+		parts[cell_part[i]].push_back(cells[i]);
+
+	int cut = 0;
+	for (int bit = 0; bit < nbits; bit++)
+		for (int pos = bit_begin[bit] + 1; pos < bit_begin[bit+1]; pos++)
+			if (cell_part[bit_cell[pos]] != cell_part[bit_cell[bit_begin[bit]]]) {
+				cut++;
+				break;
+			}
+	log("Splitting %d cells into %d parts of up to %d cells, %d signals connect the parts.\n",
+			ncells, nparts, (ncells + nparts - 1) / nparts, cut);
+	return parts;
+}
+
+// Parse the integer argument of an option, all of it. atoi() would take
+// anything that is not a number for 0.
+bool orlo_parse_int(const std::string &arg, int &value)
+{
+	char *end;
+	errno = 0;
+	long l = strtol(arg.c_str(), &end, 10);
+	if (arg.empty() || *end != 0 || errno != 0 || l < INT_MIN || l > INT_MAX)
+		return false;
+	value = int(l);
+	return true;
 }
 
 struct OrloPass : public Pass {
@@ -1489,6 +4698,12 @@ struct OrloPass : public Pass {
 		log("        generate netlists for the specified cell library (using the liberty\n");
 		log("        file format).\n");
 		log("\n");
+		log("    -noscl\n");
+		log("        let ABC read the -liberty files in every run. By default each of them\n");
+		log("        is converted to ABC's binary SC library (.scl) once, in the abc work\n");
+		log("        directory or with -cache_dir in the cache, where it is used again by\n");
+		log("        later runs until the liberty file changes.\n");
+		log("\n");
 		log("    -genlib <file>\n");
 		log("        generate netlists for the specified cell library (using the SIS Genlib\n");
 		log("        file format).\n");
@@ -1592,6 +4807,11 @@ struct OrloPass : public Pass {
 		log("        this attribute is a unique integer for each ABC process started. This\n");
 		log("        is useful for debugging the partitioning of clock domains.\n");
 		log("\n");
+		log("    -blifcomments\n");
+		log("        list the original signal name of every ys__n<id> net in a comment\n");
+		log("        block in input.blif. This is useful with -nocleanup for debugging,\n");
+		log("        but roughly doubles the size of the file.\n");
+		log("\n");
 		log("    -dress\n");
 		log("        run the 'dress' command after all other ABC commands. This aims to\n");
 		log("        preserve naming by an equivalence check between the original and post-ABC\n");
@@ -1603,6 +4823,143 @@ struct OrloPass : public Pass {
 		log("        by a random string) will be created here. Inside of this directory,\n");
 		log("        for each module a directory will be created for file transfer\n");
 		log("        to and from ABC. All will be deleted on exit if cleanup=true. The default is /tmp\n");
+		log("        The file 'manifest' in this directory has a tab-separated line for\n");
+		log("        every non-empty domain: its key (module, clock, enable and part),\n");
+		log("        sub-directory, gate, input and output counts, and the SHA1 of its\n");
+		log("        input.blif.\n");
+		log("\n");
+		log("    -j <num>\n");
+		log("        run up to <num> ABC processes concurrently. ABC runs on the modules\n");
+		log("        and clock domains already extracted while the next ones are being\n");
+		log("        extracted, and the results are reintegrated in extraction order, so\n");
+		log("        the netlist does not depend on <num>. 0 uses one process per CPU.\n");
+		log("        The default is 1.\n");
+		log("\n");
+		log("    -pipeline <N>\n");
+		log("        reintegrate the results of a module as soon as <N> more modules are\n");
+		log("        extracted, instead of after all modules, so the reintegration of\n");
+		log("        one module overlaps with ABC on the next ones. The domains of one\n");
+		log("        module are always reintegrated together. The order is fixed by <N>\n");
+		log("        alone, orlo_reint needs the same -pipeline value. The default (0)\n");
+		log("        reintegrates after all modules are extracted. The signal tables of a\n");
+		log("        domain are freed once it is reintegrated, so with a small <N> the\n");
+		log("        memory follows the modules in flight instead of the whole design.\n");
+		log("\n");
+		log("    -cache_dir <directory name>\n");
+		log("        keep the ABC results in <directory name>, keyed by a hash of the\n");
+		log("        extracted input.blif, the ABC script and the contents of the\n");
+		log("        -liberty/-genlib/-constr files. ABC is not run again for a domain\n");
+		log("        whose result is already in the cache. The number of hits and misses\n");
+		log("        is stored as 'orlo.cache_hits' and 'orlo.cache_misses' in the\n");
+		log("        scratchpad.\n");
+		log("\n");
+		log("    -max_gates <N>\n");
+		log("        split a module or clock domain with more than <N> cells into parts\n");
+		log("        of about equal size, each of which is mapped by ABC as a job of its\n");
+		log("        own (and in parallel with -j). The cells are grouped along their\n");
+		log("        connections, and the signals between the parts become inputs and\n");
+		log("        outputs of the parts, so ABC does not optimize across them.\n");
+		log("        orlo_reint needs the same -max_gates value. The default (0) does not\n");
+		log("        split.\n");
+		log("\n");
+		log("    -compress\n");
+		log("        gzip the input.blif and output.blif of every domain once ABC is done\n");
+		log("        with it. orlo_reint reads the output.blif.gz files as well. This\n");
+		log("        implies -ondisk and needs a Yosys built with zlib.\n");
+		log("\n");
+		log("    -simcheck <N>\n");
+		log("        before the output of ABC replaces the cells of a domain, simulate it\n");
+		log("        and the extracted logic on <N> random input vectors (rounded up to a\n");
+		log("        multiple of 256, 64 at a time in every word) and compare the outputs\n");
+		log("        and the inputs of the flip-flops. A domain that differs keeps its\n");
+		log("        cells, with a warning. A domain whose flip-flops ABC changed, and\n");
+		log("        the cells of -liberty and -genlib, can not be checked. The number\n");
+		log("        of domains that differ is stored as 'orlo.simcheck_mismatches' in\n");
+		log("        the scratchpad.\n");
+		log("\n");
+		log("    -emit_only\n");
+		log("        extract every module and clock domain and write its input.blif and\n");
+		log("        abc.script, but do not run ABC and leave the design unchanged. The\n");
+		log("        file 'jobs' in the abc work directory then has the ABC command of\n");
+		log("        every domain on a line of its own, for a batch scheduler to run (on\n");
+		log("        machines that see the abc work directory under the same path). Once\n");
+		log("        some or all of them are done, orlo_reint reintegrates the output.blif\n");
+		log("        files that are there, with the same options and without reloading\n");
+		log("        the design. -strategies is not supported, -cache_dir, -abc_pool and\n");
+		log("        the conversion of the liberty files have no effect.\n");
+		log("\n");
+		log("    -incremental\n");
+		log("        only run ABC for the modules and clock domains whose logic changed\n");
+		log("        since the previous run, found by 'abc.dir' in the scratchpad. The\n");
+		log("        extracted logic of every domain is fingerprinted, and a domain with\n");
+		log("        the same fingerprint, script and libraries as one of the previous\n");
+		log("        run gets the output.blif of that run reintegrated. The fingerprints\n");
+		log("        are kept in the abc work directory, so this implies -ondisk. The\n");
+		log("        numbers of reused and mapped domains are stored as\n");
+		log("        'orlo.incremental_reused' and 'orlo.incremental_mapped' in the\n");
+		log("        scratchpad.\n");
+		log("\n");
+		log("    -abc_pool\n");
+		log("        keep one ABC process running for each of the -j workers instead of\n");
+		log("        starting one for every module and clock domain. The -liberty,\n");
+		log("        -genlib and -constr files, or the generated stdcells.genlib or\n");
+		log("        lutdefs.txt in the abc work directory, are only read once when a\n");
+		log("        process starts, then the jobs are sent to it as commands. The\n");
+		log("        abc.script of every job still reads the libraries, so it can be run\n");
+		log("        on its own.\n");
+		log("\n");
+		log("    -inmem\n");
+		log("        hand the netlists, scripts and libraries to ABC in memory (Linux memfd\n");
+		log("        files) instead of writing them to the abc work directory. This is the\n");
+		log("        default when ABC is linked into Yosys and -nocleanup is not used. The\n");
+		log("        results can not be read back with orlo_reint.\n");
+		log("\n");
+		log("    -ondisk\n");
+		log("        always use the abc work directory for the files handed to ABC.\n");
+		log("\n");
+		log("    -strategies <file>\n");
+		log("        run every ABC script in <file> on each module and clock domain and\n");
+		log("        keep only the best result. Each non-empty line that does not start\n");
+		log("        with '#' is one script: ABC commands separated by ';', with {D}, {I},\n");
+		log("        {P} and {S} replaced as in the default scripts, or 'default' or 'fast'\n");
+		log("        for the default script of the target. All scripts read the same\n");
+		log("        input.blif and run in parallel with -j. Each result is scored by the\n");
+		log("        area and delay ABC reports with 'stime' (with -liberty) or\n");
+		log("        'print_stats' at the end of the script (for LUT and SOP networks the\n");
+		log("        number of nodes and levels).\n");
+		log("\n");
+		log("    -strategy_metric area|delay\n");
+		log("        the metric -strategies selects by. The other metric breaks ties, and\n");
+		log("        then the earlier script wins. The default is area.\n");
+		log("\n");
+		log("    -stats <file>\n");
+		log("        write the wall time, the CPU time and the peak RSS of every phase of\n");
+		log("        every module and clock domain to <file> as JSON, together with the\n");
+		log("        number of gates, inputs and outputs and the area and delay ABC\n");
+		log("        reported, if any. The phases are the clock domain partitioning (per\n");
+		log("        module), extract, loops, write_blif, abc, read_blif, simcheck and\n");
+		log("        reintegrate. The CPU time and the peak RSS of the abc phase are\n");
+		log("        those of the ABC processes, the CPU time is only exact with -j 1.\n");
+		log("\n");
+		log("    -progress <seconds>\n");
+		log("        every <seconds> seconds while ABC runs, log how many domains are\n");
+		log("        waiting for ABC, being mapped and done, the gates mapped per second\n");
+		log("        and the time left for the domains extracted so far, and the domain\n");
+		log("        that has been running the longest. The same goes to 'status.json' in\n");
+		log("        the abc work directory, with every running domain and how long it\n");
+		log("        has been running, for other tools to watch. Only the gates of the\n");
+		log("        domains ABC runs for count, not those of -incremental and empty ones.\n");
+		log("\n");
+		log("    -refine <percent>\n");
+		log("        map every domain once with 'stime' or 'print_stats' at the end of its\n");
+		log("        script, then map the domains whose delay is within <percent> of the\n");
+		log("        delay of the worst domain a second time, with {D} set to a delay\n");
+		log("        target <percent> below their own delay. The faster of the two\n");
+		log("        results is used, the others are not mapped again. Only scripts with\n");
+		log("        {D} are refined, the default scripts for -lut and -sop have none,\n");
+		log("        and domains taken from the previous run by -incremental have no\n");
+		log("        delay. Can not be combined with -strategies, -pipeline and\n");
+		log("        -emit_only.\n");
 		log("\n");
 		log("When no target cell library is specified the Yosys standard cell library is\n");
 		log("loaded into ABC before the ABC script is executed.\n");
@@ -1622,13 +4979,6 @@ struct OrloPass : public Pass {
 		log_header(design, "Executing ORLO pass (technology mapping using ABC).\n");
 		log_push();
 
-		assign_map.clear();
-		signal_list.clear();
-		signal_map.clear();
-		initvals.clear();
-		pi_map.clear();
-		po_map.clear();
-
 		std::string exe_file = yosys_abc_executable;
 		std::string script_file, default_liberty_file, constr_file, clk_str, tempdir_name, abc_topdir = "/tmp";
 		std::vector<std::string> liberty_files, genlib_files;
@@ -1636,8 +4986,23 @@ struct OrloPass : public Pass {
 		bool fast_mode = false, dff_mode = false, keepff = false, cleanup = true;
 		bool show_tempdir = false, sop_mode = false;
 		bool abc_dress = false;
+		int nprocs = 1;
+		bool inmem = false, ondisk = false;
+		std::string strategies_file;
+		std::vector<std::string> strategies;
+		bool strategy_delay = false;
+		std::string stats_file;
+		orlo_phase_timer_t total_timer;
+		std::vector<std::pair<RTLIL::IdString, orlo_phase_stats_t>> partitions;
+		orlo_abc_pool_t abc_pool;
+		orlo_incremental_t incremental;
+		bool scl = true, emit_only = false, compress = false;
+		int max_gates = 0, pipeline = 0, simcheck = 0, refine = 0;
+		double progress = 0;
+		orlo_cache_t cache;
 		vector<int> lut_costs;
 		markgroups = false;
+		blif_comments = false;
 
 		map_mux4 = false;
 		map_mux8 = false;
@@ -1803,19 +5168,142 @@ struct OrloPass : public Pass {
 				markgroups = true;
 				continue;
 			}
+			if (arg == "-blifcomments") {
+				blif_comments = true;
+				continue;
+			}
 			if (arg == "-abc_topdir") {
 				abc_topdir = args[++argidx];
 				continue;
 			}
+			if (arg == "-j" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], nprocs) || nprocs < 0)
+					log_cmd_error("Invalid number of jobs for -j.\n");
+				if (nprocs == 0)
+					nprocs = std::max(1, int(std::thread::hardware_concurrency()));
+				continue;
+			}
+			if (arg == "-cache_dir" && argidx+1 < args.size()) {
+				cache.dir = args[++argidx];
+				continue;
+			}
+			if (arg == "-inmem") {
+				inmem = true;
+				continue;
+			}
+			if (arg == "-ondisk") {
+				ondisk = true;
+				continue;
+			}
+			if (arg == "-strategies" && argidx+1 < args.size()) {
+				strategies_file = args[++argidx];
+				continue;
+			}
+			if (arg == "-stats" && argidx+1 < args.size()) {
+				stats_file = args[++argidx];
+				continue;
+			}
+			if (arg == "-abc_pool") {
+				abc_pool.enabled = true;
+				continue;
+			}
+			if (arg == "-max_gates" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], max_gates) || max_gates < 0)
+					log_cmd_error("Invalid number of gates for -max_gates.\n");
+				continue;
+			}
+			if (arg == "-pipeline" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], pipeline) || pipeline < 0)
+					log_cmd_error("Invalid depth for -pipeline.\n");
+				continue;
+			}
+			if (arg == "-emit_only") {
+				emit_only = true;
+				continue;
+			}
+			if (arg == "-simcheck" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], simcheck) || simcheck < 0)
+					log_cmd_error("Invalid number of vectors for -simcheck.\n");
+				continue;
+			}
+			if (arg == "-compress") {
+				compress = true;
+				continue;
+			}
+			if (arg == "-incremental") {
+				incremental.enabled = true;
+				continue;
+			}
+			if (arg == "-noscl") {
+				scl = false;
+				continue;
+			}
+			if (arg == "-strategy_metric" && argidx+1 < args.size()) {
+				std::string metric = args[++argidx];
+				if (metric != "area" && metric != "delay")
+					log_cmd_error("Invalid metric for -strategy_metric: %s\n", metric.c_str());
+				strategy_delay = metric == "delay";
+				continue;
+			}
+			if (arg == "-progress" && argidx+1 < args.size()) {
+				const std::string &value = args[++argidx];
+				char *end;
+				progress = strtod(value.c_str(), &end);
+				if (value.empty() || *end != 0 || !(progress > 0))
+					log_cmd_error("Invalid interval for -progress.\n");
+				continue;
+			}
+			if (arg == "-refine" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], refine) || refine <= 0 || refine >= 100)
+					log_cmd_error("Invalid percentage for -refine.\n");
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+#ifdef YOSYS_LINK_ABC
+		if (cleanup)
+			inmem = true;
+#endif
+#ifndef YOSYS_ENABLE_ZLIB
+		if (compress)
+			log_cmd_error("-compress needs a Yosys built with zlib.\n");
+#endif
+		if (ondisk || incremental.enabled || emit_only || compress)
+			inmem = false;
+		if (refine > 0) {
+			if (!strategies_file.empty())
+				log_cmd_error("-refine can not be combined with -strategies.\n");
+			if (pipeline > 0)
+				log_cmd_error("-refine needs all domains mapped before any is reintegrated, it can not be combined with -pipeline.\n");
+			if (emit_only)
+				log_cmd_error("-refine can not be combined with -emit_only.\n");
+		}
+		if (emit_only) {
+			if (!strategies_file.empty())
+				log_cmd_error("-emit_only can not be combined with -strategies.\n");
+			if (simcheck > 0)
+				log_cmd_error("-emit_only can not be combined with -simcheck, use it with orlo_reint.\n");
+			// Nothing runs here, the liberty files are read where ABC runs
+			cache.dir.clear();
+			abc_pool.enabled = false;
+			scl = false;
+		}
+#ifndef __linux__
+		if (inmem) {
+			log_warning("-inmem is only supported on Linux, using the abc work directory.\n");
+			inmem = false;
+		}
+#endif
+
         // This assumes any non-absolute path name means its relative to current working directory
         if (!is_absolute_path(abc_topdir)) {
             abc_topdir = std::string(pwd) + "/" + abc_topdir;
         }
 		std::string topdir_name = abc_topdir + "/yosys-abc-XXXXXX";
+		if (incremental.enabled)
+			incremental.load(design->scratchpad_get_string("abc.dir"));
 		topdir_name = make_temp_dir(topdir_name);
 		// This is how we get it to Python
 		design->scratchpad_set_string("abc.dir", topdir_name.c_str());
@@ -1840,6 +5328,47 @@ struct OrloPass : public Pass {
 		if (!constr_file.empty() && !is_absolute_path(constr_file))
 			constr_file = std::string(pwd) + "/" + constr_file;
 
+		if (!strategies_file.empty()) {
+			rewrite_filename(strategies_file);
+			std::ifstream f(strategies_file);
+			if (f.fail())
+				log_cmd_error("Can't open strategies file `%s': %s\n", strategies_file.c_str(), strerror(errno));
+			std::string line;
+			while (std::getline(f, line)) {
+				size_t first = line.find_first_not_of(" \t\r");
+				if (first == std::string::npos || line[first] == '#')
+					continue;
+				strategies.push_back(line.substr(first, line.find_last_not_of(" \t\r") + 1 - first));
+			}
+			if (strategies.empty())
+				log_cmd_error("No strategies in `%s'.\n", strategies_file.c_str());
+			log("Trying %d strategies from `%s' for every domain.\n", GetSize(strategies), strategies_file.c_str());
+		}
+
+#if defined(YOSYS_LINK_ABC) || defined(_WIN32)
+		if (abc_pool.enabled) {
+			log_warning("-abc_pool needs an ABC executable, running ABC once for every job.\n");
+			abc_pool.enabled = false;
+		}
+#endif
+		if (cache.enabled()) {
+			rewrite_filename(cache.dir);
+			if (!is_absolute_path(cache.dir))
+				cache.dir = std::string(pwd) + "/" + cache.dir;
+			if (mkdir(cache.dir.c_str(), 0777) != 0 && errno != EEXIST)
+				log_cmd_error("Could not create cache directory %s: %s\n", cache.dir.c_str(), strerror(errno));
+			cache.set_libraries(exe_file, liberty_files, genlib_files, constr_file, script_file);
+			cache.copy_to_tempdir = !cleanup;
+		}
+		if (incremental.enabled)
+			incremental.lib_hash = orlo_library_hash(exe_file, liberty_files, genlib_files, constr_file, script_file);
+
+		// Parse every liberty file once, not in every run of ABC
+		if (scl)
+			for (auto &liberty_file : liberty_files)
+				liberty_file = orlo_liberty_scl(exe_file, liberty_file, cache.enabled() ? cache.dir : topdir_name);
+		abc_pool.library_commands = orlo_library_commands(liberty_files, genlib_files, constr_file);
+
 		// handle -lut argument
 		if (!lut_arg.empty()) {
 			size_t pos = lut_arg.find_first_of(':');
@@ -2021,6 +5550,73 @@ struct OrloPass : public Pass {
 			// enabled_gates.insert("NMUX");
 		}
 
+		orlo_builtin_library_t builtin_library;
+		if (liberty_files.empty() && genlib_files.empty()) {
+			builtin_library.generate(lut_costs);
+			if (!inmem) {
+				builtin_library.write(topdir_name);
+				// A process of the pool reads it once, like the -liberty files
+				if (abc_pool.enabled)
+					abc_pool.library_commands.push_back(builtin_library.command(topdir_name));
+			}
+		}
+
+		// ABC runs on the worker threads of the scheduler while the next
+		// domains are extracted. The jobs of a module are reintegrated all
+		// at once, after all of them are extracted, in the order they were
+		// extracted in, so the names do not depend on the timing.
+		std::deque<orlo_job_t> jobs;
+		std::vector<std::pair<size_t, size_t>> module_jobs;
+		size_t next_module = 0;
+		int reused = 0, mapped = 0;
+		orlo_abc_scheduler_t scheduler(exe_file, cache, abc_pool, nprocs, emit_only);
+		if (progress > 0)
+			scheduler.set_progress(progress, topdir_name + "/status.json");
+
+		// With -emit_only the extracted cells stay, and the loops are undone
+		// once the files are written: the design is not changed. With
+		// -simcheck they stay until the output of ABC is checked.
+		auto submit_module = [&](RTLIL::Module *mod, size_t first_job) {
+			for (size_t i = first_job; i < jobs.size() && !emit_only; i++)
+				if (simcheck == 0 || jobs[i].count_output == 0)
+					for (auto cell : jobs[i].extracted_cells)
+						mod->remove(cell);
+			for (size_t i = first_job; i < jobs.size(); i++) {
+				if (incremental.enabled && jobs[i].count_output > 0) {
+					incremental.compute(jobs[i], strategy_delay);
+					if (incremental.lookup(jobs[i]))
+						reused++;
+					else
+						mapped++;
+				}
+				scheduler.submit(jobs[i]);
+			}
+			module_jobs.push_back(std::make_pair(first_job, jobs.size()));
+		};
+
+		int cache_hits = 0, cache_misses = 0;
+		auto finish_module = [&]() {
+			for (size_t i = module_jobs[next_module].first; i < module_jobs[next_module].second; i++) {
+				orlo_job_t &job = jobs[i];
+				scheduler.wait(job);
+				if (cache.enabled() && job.count_output > 0 && !job.reused) {
+					// Before the best of the -strategies is picked
+					if (job.strategies.empty())
+						job.cache_hit ? cache_hits++ : cache_misses++;
+					for (auto &run : job.strategies)
+						run.cache_hit ? cache_hits++ : cache_misses++;
+				}
+				if (emit_only)
+					orlo_undo_loops(job);
+				else
+					orlo_module_finish(design, job, liberty_files, genlib_files, show_tempdir, sop_mode,
+							strategy_delay || refine > 0, simcheck);
+				incremental.store(job);
+				job.release();
+			}
+			next_module++;
+		};
+
 		for (auto mod : design->selected_modules())
 		{
 			if (mod->processes.size() > 0) {
@@ -2028,169 +5624,88 @@ struct OrloPass : public Pass {
 				continue;
 			}
 
-			assign_map.set(mod);
-			initvals.set(&assign_map, mod);
-
+			size_t first_job = jobs.size();
 			if (!dff_mode || !clk_str.empty()) {
-				orlo_module(design, mod, script_file, exe_file, liberty_files, genlib_files, constr_file, cleanup, lut_costs, dff_mode, clk_str, keepff,
-                           delay_target, sop_inputs, sop_products, lutin_shared, fast_mode, mod->selected_cells(), show_tempdir, sop_mode, abc_dress, topdir_name, 0);
-				continue;
-			}
-
-			CellTypes ct(design);
-
-			std::vector<RTLIL::Cell*> all_cells = mod->selected_cells();
-			std::set<RTLIL::Cell*> unassigned_cells(all_cells.begin(), all_cells.end());
-
-			std::set<RTLIL::Cell*> expand_queue, next_expand_queue;
-			std::set<RTLIL::Cell*> expand_queue_up, next_expand_queue_up;
-			std::set<RTLIL::Cell*> expand_queue_down, next_expand_queue_down;
-
-			typedef tuple<bool, RTLIL::SigSpec, bool, RTLIL::SigSpec> clkdomain_t;
-			std::map<clkdomain_t, std::vector<RTLIL::Cell*>> assigned_cells;
-			std::map<RTLIL::Cell*, clkdomain_t> assigned_cells_reverse;
-
-			std::map<RTLIL::Cell*, std::set<RTLIL::SigBit>> cell_to_bit, cell_to_bit_up, cell_to_bit_down;
-			std::map<RTLIL::SigBit, std::set<RTLIL::Cell*>> bit_to_cell, bit_to_cell_up, bit_to_cell_down;
-
-			for (auto cell : all_cells)
-			{
-				clkdomain_t key;
-
-				for (auto &conn : cell->connections())
-				for (auto bit : conn.second) {
-					bit = assign_map(bit);
-					if (bit.wire != nullptr) {
-						cell_to_bit[cell].insert(bit);
-						bit_to_cell[bit].insert(cell);
-						if (ct.cell_input(cell->type, conn.first)) {
-							cell_to_bit_up[cell].insert(bit);
-							bit_to_cell_down[bit].insert(cell);
-						}
-						if (ct.cell_output(cell->type, conn.first)) {
-							cell_to_bit_down[cell].insert(bit);
-							bit_to_cell_up[bit].insert(cell);
-						}
-					}
-				}
-
-				if (cell->type.in(ID($_DFF_N_), ID($_DFF_P_)))
-				{
-					key = clkdomain_t(cell->type == ID($_DFF_P_), assign_map(cell->getPort(ID::C)), true, RTLIL::SigSpec());
+				std::vector<std::vector<RTLIL::Cell*>> parts = orlo_split_cells(mod, mod->selected_cells(), max_gates);
+				for (int i = 0; i < GetSize(parts); i++) {
+					jobs.emplace_back(mod);
+					jobs.back().inmem = inmem;
+					jobs.back().compress = compress;
+					if (builtin_library.enabled)
+						jobs.back().library = &builtin_library;
+					jobs.back().part = i;
+					orlo_module(design, jobs.back(), script_file, strategies, liberty_files, genlib_files, constr_file, cleanup, lut_costs, dff_mode, clk_str, keepff,
+                               delay_target, sop_inputs, sop_products, lutin_shared, fast_mode, parts[i], show_tempdir, sop_mode, abc_dress, topdir_name, i,
+                               refine > 0);
 				}
-				else
-				if (cell->type.in(ID($_DFFE_NN_), ID($_DFFE_NP_), ID($_DFFE_PN_), ID($_DFFE_PP_)))
-				{
-					bool this_clk_pol = cell->type.in(ID($_DFFE_PN_), ID($_DFFE_PP_));
-					bool this_en_pol = cell->type.in(ID($_DFFE_NP_), ID($_DFFE_PP_));
-					key = clkdomain_t(this_clk_pol, assign_map(cell->getPort(ID::C)), this_en_pol, assign_map(cell->getPort(ID::E)));
+			} else {
+				orlo_phase_timer_t partition_timer;
+				std::map<clkdomain_t, std::vector<RTLIL::Cell*>> assigned_cells = orlo_clock_domains(design, mod, mod->selected_cells());
+				partitions.push_back(std::make_pair(mod->name, partition_timer.stop()));
+
+				int clk_domain = 0;
+				for (auto &it : assigned_cells) {
+					std::vector<std::vector<RTLIL::Cell*>> parts = orlo_split_cells(mod, it.second, max_gates);
+					std::vector<RTLIL::Cell*>().swap(it.second);
+					for (int i = 0; i < GetSize(parts); i++) {
+						jobs.emplace_back(mod);
+						orlo_job_t &job = jobs.back();
+						job.inmem = inmem;
+						job.compress = compress;
+						if (builtin_library.enabled)
+							job.library = &builtin_library;
+						job.part = i;
+						job.clk_polarity = std::get<0>(it.first);
+						job.clk_sig = job.assign_map(std::get<1>(it.first));
+						job.en_polarity = std::get<2>(it.first);
+						job.en_sig = job.assign_map(std::get<3>(it.first));
+						orlo_module(design, job, script_file, strategies, liberty_files, genlib_files, constr_file, cleanup, lut_costs, !job.clk_sig.empty(), "$",
+								keepff, delay_target, sop_inputs, sop_products, lutin_shared, fast_mode, parts[i], show_tempdir, sop_mode, abc_dress, topdir_name, clk_domain,
+								refine > 0);
+						std::vector<RTLIL::Cell*>().swap(parts[i]);
+						clk_domain++;
+					}
 				}
-				else
-					continue;
-
-				unassigned_cells.erase(cell);
-				expand_queue.insert(cell);
-				expand_queue_up.insert(cell);
-				expand_queue_down.insert(cell);
-
-				assigned_cells[key].push_back(cell);
-				assigned_cells_reverse[cell] = key;
 			}
 
-			while (!expand_queue_up.empty() || !expand_queue_down.empty())
-			{
-				if (!expand_queue_up.empty())
-				{
-					RTLIL::Cell *cell = *expand_queue_up.begin();
-					clkdomain_t key = assigned_cells_reverse.at(cell);
-					expand_queue_up.erase(cell);
-
-					for (auto bit : cell_to_bit_up[cell])
-					for (auto c : bit_to_cell_up[bit])
-						if (unassigned_cells.count(c)) {
-							unassigned_cells.erase(c);
-							next_expand_queue_up.insert(c);
-							assigned_cells[key].push_back(c);
-							assigned_cells_reverse[c] = key;
-							expand_queue.insert(c);
-						}
-				}
+			submit_module(mod, first_job);
+			if (pipeline > 0 && module_jobs.size() - next_module > size_t(pipeline))
+				finish_module();
+		}
 
-				if (!expand_queue_down.empty())
-				{
-					RTLIL::Cell *cell = *expand_queue_down.begin();
-					clkdomain_t key = assigned_cells_reverse.at(cell);
-					expand_queue_down.erase(cell);
-
-					for (auto bit : cell_to_bit_down[cell])
-					for (auto c : bit_to_cell_down[bit])
-						if (unassigned_cells.count(c)) {
-							unassigned_cells.erase(c);
-							next_expand_queue_up.insert(c);
-							assigned_cells[key].push_back(c);
-							assigned_cells_reverse[c] = key;
-							expand_queue.insert(c);
-						}
-				}
+		scheduler.finish_submitting();
+		if (refine > 0)
+			orlo_refine_delays(jobs, scheduler, refine);
 
-				if (expand_queue_up.empty() && expand_queue_down.empty()) {
-					expand_queue_up.swap(next_expand_queue_up);
-					expand_queue_down.swap(next_expand_queue_down);
-				}
-			}
+		while (next_module < module_jobs.size())
+			finish_module();
+		scheduler.report(true);
 
-			while (!expand_queue.empty())
-			{
-				RTLIL::Cell *cell = *expand_queue.begin();
-				clkdomain_t key = assigned_cells_reverse.at(cell);
-				expand_queue.erase(cell);
-
-				for (auto bit : cell_to_bit.at(cell)) {
-					for (auto c : bit_to_cell[bit])
-						if (unassigned_cells.count(c)) {
-							unassigned_cells.erase(c);
-							next_expand_queue.insert(c);
-							assigned_cells[key].push_back(c);
-							assigned_cells_reverse[c] = key;
-						}
-					bit_to_cell[bit].clear();
-				}
+		if (!inmem)
+			orlo_manifest_t::write(topdir_name, jobs);
+		if (emit_only)
+			orlo_write_job_file(topdir_name, exe_file, jobs);
 
-				if (expand_queue.empty())
-					expand_queue.swap(next_expand_queue);
-			}
+		if (incremental.enabled) {
+			log("Incremental: %d domains unchanged since %s, %d mapped.\n", reused,
+					incremental.previous_dir.empty() ? "(no previous run)" : incremental.previous_dir.c_str(), mapped);
+			design->scratchpad_set_int("orlo.incremental_reused", reused);
+			design->scratchpad_set_int("orlo.incremental_mapped", mapped);
+		}
 
-			clkdomain_t key(true, RTLIL::SigSpec(), true, RTLIL::SigSpec());
-			for (auto cell : unassigned_cells) {
-				assigned_cells[key].push_back(cell);
-				assigned_cells_reverse[cell] = key;
-			}
+		if (simcheck > 0)
+			orlo_simcheck_summary(design, jobs);
 
-			log_header(design, "Summary of detected clock domains:\n");
-			for (auto &it : assigned_cells)
-				log("  %d cells in clk=%s%s, en=%s%s\n", GetSize(it.second),
-						std::get<0>(it.first) ? "" : "!", log_signal(std::get<1>(it.first)),
-						std::get<2>(it.first) ? "" : "!", log_signal(std::get<3>(it.first)));
-            
-            int clk_domain = 0;
-			for (auto &it : assigned_cells) {
-				clk_polarity = std::get<0>(it.first);
-				clk_sig = assign_map(std::get<1>(it.first));
-				en_polarity = std::get<2>(it.first);
-				en_sig = assign_map(std::get<3>(it.first));
-				orlo_module(design, mod, script_file, exe_file, liberty_files, genlib_files, constr_file, cleanup, lut_costs, !clk_sig.empty(), "$",
-                           keepff, delay_target, sop_inputs, sop_products, lutin_shared, fast_mode, it.second, show_tempdir, sop_mode, abc_dress, topdir_name, clk_domain);
-				assign_map.set(mod);
-                clk_domain++;
-			}
+		if (cache.enabled()) {
+			log("ABC cache %s: %d hits, %d misses.\n", cache.dir.c_str(), cache_hits, cache_misses);
+			design->scratchpad_set_int("orlo.cache_hits", cache_hits);
+			design->scratchpad_set_int("orlo.cache_misses", cache_misses);
 		}
 
-		assign_map.clear();
-		signal_list.clear();
-		signal_map.clear();
-		initvals.clear();
-		pi_map.clear();
-		po_map.clear();
+		if (!stats_file.empty()) {
+			rewrite_filename(stats_file);
+			orlo_write_stats(stats_file, partitions, jobs, total_timer.stop());
+		}
 
 		log_pop();
 	}
@@ -2198,25 +5713,21 @@ struct OrloPass : public Pass {
 
 
 
-void orlo_module_reint(RTLIL::Design *design, RTLIL::Module *current_module, 
-                      std::vector<std::string> &liberty_files, std::vector<std::string> &genlib_files, bool dff_mode, std::string clk_str,
-        bool keepff, const std::vector<RTLIL::Cell *> &cells, bool sop_mode, std::string abc_dir, int clk_domain)
+void orlo_module_reint(orlo_job_t &job, bool dff_mode, std::string clk_str,
+        bool keepff, const std::vector<RTLIL::Cell *> &cells, std::string abc_dir, int clk_domain,
+		const orlo_manifest_t &manifest)
 {
-	module = current_module;
-	map_autoidx = autoidx++;
-
-	signal_map.clear();
-	signal_list.clear();
-	pi_map.clear();
-	po_map.clear();
-	recover_init = false;   // DBM  mmm, not certain about this one
+	orlo_phase_timer_t extract_timer;
+	job.map_autoidx = autoidx++;
+	job.clk_domain = clk_domain;
+	job.recover_init = false;   // DBM  mmm, not certain about this one
 
 	if (clk_str != "$") {
-		clk_polarity = true;
-		clk_sig = RTLIL::SigSpec();
+		job.clk_polarity = true;
+		job.clk_sig = RTLIL::SigSpec();
 
-		en_polarity = true;
-		en_sig = RTLIL::SigSpec();
+		job.en_polarity = true;
+		job.en_sig = RTLIL::SigSpec();
 	}
 
 	if (!clk_str.empty() && clk_str != "$") {
@@ -2225,57 +5736,93 @@ void orlo_module_reint(RTLIL::Design *design, RTLIL::Module *current_module,
 			std::string en_str = clk_str.substr(pos + 1);
 			clk_str = clk_str.substr(0, pos);
 			if (en_str[0] == '!') {
-				en_polarity = false;
+				job.en_polarity = false;
 				en_str = en_str.substr(1);
 			}
-			if (module->wire(RTLIL::escape_id(en_str)) != nullptr)
-				en_sig = assign_map(module->wire(RTLIL::escape_id(en_str)));
+			if (job.module->wire(RTLIL::escape_id(en_str)) != nullptr)
+				job.en_sig = job.assign_map(job.module->wire(RTLIL::escape_id(en_str)));
 		}
 		if (clk_str[0] == '!') {
-			clk_polarity = false;
+			job.clk_polarity = false;
 			clk_str = clk_str.substr(1);
 		}
-		if (module->wire(RTLIL::escape_id(clk_str)) != nullptr)
-			clk_sig = assign_map(module->wire(RTLIL::escape_id(clk_str)));
+		if (job.module->wire(RTLIL::escape_id(clk_str)) != nullptr)
+			job.clk_sig = job.assign_map(job.module->wire(RTLIL::escape_id(clk_str)));
 	}
 
-	if (dff_mode && clk_sig.empty())
+	if (dff_mode && job.clk_sig.empty())
 		log_cmd_error("Clock domain %s not found.\n", clk_str.c_str());
 
 	if (dff_mode || !clk_str.empty()) {
-		if (clk_sig.size() == 0)
+		if (job.clk_sig.size() == 0)
 			log("No%s clock domain found. Not extracting any FF cells.\n", clk_str.empty() ? "" : " matching");
 		else {
-			log("Found%s %s clock domain: %s", clk_str.empty() ? "" : " matching", clk_polarity ? "posedge" : "negedge",
-			    log_signal(clk_sig));
-			if (en_sig.size() != 0)
-				log(", enabled by %s%s", en_polarity ? "" : "!", log_signal(en_sig));
+			log("Found%s %s clock domain: %s", clk_str.empty() ? "" : " matching", job.clk_polarity ? "posedge" : "negedge",
+			    log_signal(job.clk_sig));
+			if (job.en_sig.size() != 0)
+				log(", enabled by %s%s", job.en_polarity ? "" : "!", log_signal(job.en_sig));
 			log("\n");
 		}
 	}
 
-	for (auto c : cells)
-		extract_cell(c, keepff);
-
-	for (auto wire : module->wires()) {
-		if (wire->port_id > 0 || wire->get_bool_attribute(ID::keep))
-			mark_port(wire);
+	// Without a manifest (an abc work directory of an older version) the
+	// directory is found by the position of the domain.
+	job.domain_key = orlo_domain_key(job);
+	job.tempdir_name = orlo_module2name(job.module, abc_dir, clk_domain);
+	if (manifest.present) {
+		auto it = manifest.domains.find(job.domain_key);
+		if (it != manifest.domains.end())
+			job.tempdir_name = abc_dir + "/" + it->second.subdir;
+		else
+			job.unlisted = true;
 	}
+	job.output_blif = job.tempdir_name + "/output.blif";
+
+	// orlo leaves the signals of the extraction in signals.bin, then the
+	// domain need not be extracted again.
+	if (!job.unlisted && orlo_read_signals(job, job.tempdir_name + "/signals.bin")) {
+		log("Using the signals of the extraction in %s/signals.bin.\n", job.tempdir_name.c_str());
+		job.phases[ORLO_PHASE_EXTRACT].add(extract_timer.stop());
+	} else {
+		for (auto c : cells)
+			if (extract_cell(job, c, keepff))
+				job.extracted_cells.push_back(c);
+
+		pool<RTLIL::Cell *> extracted(job.extracted_cells.begin(), job.extracted_cells.end());
+
+		for (auto wire : job.module->wires()) {
+			if (wire->port_id > 0 || wire->get_bool_attribute(ID::keep))
+				mark_port(job, wire);
+		}
 
-	for (auto cell : module->cells())
-		for (auto &port_it : cell->connections())
-			mark_port(port_it.second);
+		for (auto cell : job.module->cells()) {
+			if (extracted.count(cell))
+				continue;
+			for (auto &port_it : cell->connections())
+				mark_port(job, port_it.second);
+		}
 
-	if (clk_sig.size() != 0)
-		mark_port(clk_sig);
+		if (job.clk_sig.size() != 0)
+			mark_port(job, job.clk_sig);
 
-	if (en_sig.size() != 0)
-		mark_port(en_sig);
+		if (job.en_sig.size() != 0)
+			mark_port(job, job.en_sig);
 
-	handle_loops();
-    std::string moddir_name;
-    moddir_name = orlo_module2name(module, abc_dir, clk_domain);
-	orlo_reintegrate(design, module, liberty_files, genlib_files, sop_mode, moddir_name);
+		job.phases[ORLO_PHASE_EXTRACT].add(extract_timer.stop());
+		orlo_phase_timer_t loops_timer;
+		handle_loops(job);
+		job.phases[ORLO_PHASE_LOOPS].add(loops_timer.stop());
+	}
+
+	for (auto &si : job.signal_list) {
+		if (si.is_port && si.type == G(NONE))
+			job.count_input++;
+		if (si.is_port && si.type != G(NONE))
+			job.count_output++;
+		if (si.type != G(NONE))
+			job.count_gates++;
+	}
+	job.finish_extraction();
 }
 
 struct OrloReintegratePass : public Pass {
@@ -2288,11 +5835,43 @@ struct OrloReintegratePass : public Pass {
 		log("\n");
 		log("This pass reintegrates ABC mapped modules back into an unmapped design\n");
 		log("\n");
+		log("orlo writes the signal map of every extraction to signals.bin next to the\n");
+		log("input.blif. When that matches the module, the domain is not extracted again:\n");
+		log("the signals, the broken loops and the cells to replace are taken from it.\n");
+		log("Otherwise the domain is extracted like orlo did. The manifest file in the\n");
+		log("abc work directory maps the module, clock domain and part of every domain\n");
+		log("that was not empty to its sub-directory, the others have nothing to\n");
+		log("reintegrate. A domain in the manifest whose output.blif is missing, one of\n");
+		log("'orlo -emit_only' that was not mapped yet, keeps its cells unmapped.\n");
+		log("\n");
 		log("    -abc_dir <directory name>\n");
 		log("        set the root level of the abc work directory to be <directory name>.\n");
 		log("        sub-directories for each module are expected here, each with an output.blif\n");
 		log("        file produced by ABC. Default is the value of 'abc.dir' in the design's scratchpad. \n");
 		log("\n");
+		log("    -max_gates <N>\n");
+		log("        split the domains like 'orlo -max_gates <N>' did. This must be the\n");
+		log("        same value, so that the parts match the sub-directories.\n");
+		log("\n");
+		log("    -j <N>\n");
+		log("        load and tokenize the output.blif files on <N> worker threads (0 for\n");
+		log("        one per CPU) before they are reintegrated one after another. The\n");
+		log("        result does not depend on <N>. The outputs of a module are kept in\n");
+		log("        memory until they are reintegrated.\n");
+		log("\n");
+		log("    -pipeline <N>\n");
+		log("        reintegrate the modules in the same order as 'orlo -pipeline <N>'\n");
+		log("        did. This must be the same value, or the generated names differ.\n");
+		log("\n");
+		log("    -simcheck <N>\n");
+		log("        check the output.blif of every domain against its extracted logic on\n");
+		log("        <N> random vectors before it replaces the cells, like 'orlo -simcheck'.\n");
+		log("        This also checks the domains of 'orlo -emit_only'.\n");
+		log("\n");
+		log("    -stats <file>\n");
+		log("        write the time and memory statistics of every phase to <file>, like\n");
+		log("        'orlo -stats'. The write_blif and abc phases are not part of this pass.\n");
+		log("\n");
 		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
@@ -2300,19 +5879,16 @@ struct OrloReintegratePass : public Pass {
 		log_header(design, "Executing ABC reintegrate pass.\n");
 		log_push();
 
-		assign_map.clear();
-		signal_list.clear();
-		signal_map.clear();
-		initvals.clear();
-		pi_map.clear();
-		po_map.clear();
-
 		std::string default_liberty_file, clk_str;
 		std::vector<std::string> liberty_files, genlib_files;
         std::string abc_dir = "";
         
 		bool dff_mode = false, keepff = false;
 		bool sop_mode = false;
+		int max_gates = 0, nprocs = 1, pipeline = 0, simcheck = 0;
+		std::string stats_file;
+		orlo_phase_timer_t total_timer;
+		std::vector<std::pair<RTLIL::IdString, orlo_phase_stats_t>> partitions;
 
 		enabled_gates.clear();
 
@@ -2370,6 +5946,32 @@ struct OrloReintegratePass : public Pass {
 				abc_dir = args[++argidx];
 				continue;
 			}
+			if (arg == "-max_gates" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], max_gates) || max_gates < 0)
+					log_cmd_error("Invalid number of gates for -max_gates.\n");
+				continue;
+			}
+			if (arg == "-j" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], nprocs) || nprocs < 0)
+					log_cmd_error("Invalid number of jobs for -j.\n");
+				if (nprocs == 0)
+					nprocs = std::max(1, int(std::thread::hardware_concurrency()));
+				continue;
+			}
+			if (arg == "-pipeline" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], pipeline) || pipeline < 0)
+					log_cmd_error("Invalid depth for -pipeline.\n");
+				continue;
+			}
+			if (arg == "-simcheck" && argidx+1 < args.size()) {
+				if (!orlo_parse_int(args[++argidx], simcheck) || simcheck < 0)
+					log_cmd_error("Invalid number of vectors for -simcheck.\n");
+				continue;
+			}
+			if (arg == "-stats" && argidx + 1 < args.size()) {
+				stats_file = args[++argidx];
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
@@ -2378,6 +5980,9 @@ struct OrloReintegratePass : public Pass {
     	   log_error("An ABC work directory must be specified\n");
 		}
 
+		orlo_manifest_t manifest;
+		manifest.load(abc_dir);
+
 
 		if (liberty_files.empty() && !default_liberty_file.empty())
 			liberty_files.push_back(default_liberty_file);
@@ -2389,168 +5994,98 @@ struct OrloReintegratePass : public Pass {
 		}
 
 
+		// The outputs of a module are loaded when it is reintegrated, in
+		// parallel with -j. The modules are reintegrated in the same order
+		// as orlo did, with the same -pipeline, so that the generated names
+		// match those of the original orlo run.
+		std::deque<orlo_job_t> jobs;
+		std::vector<std::pair<size_t, size_t>> module_jobs;
+		size_t next_module = 0;
+
+		auto finish_module = [&]() {
+			size_t first = module_jobs[next_module].first, last = module_jobs[next_module].second;
+			std::vector<orlo_blif_output_t> outputs(last - first);
+			orlo_load_outputs(jobs, first, last, outputs, nprocs);
+			for (size_t i = first; i < last; i++) {
+				// A domain of 'orlo -emit_only' may not be mapped yet, then
+				// its cells stay as they are.
+				if (manifest.present && !jobs[i].unlisted && !outputs[i - first].missing.empty()) {
+					log("ABC output %s is not there, keeping the cells of the domain.\n", jobs[i].output_blif.c_str());
+					orlo_undo_loops(jobs[i]);
+					jobs[i].release();
+					continue;
+				}
+				if (!orlo_simcheck_job(jobs[i], outputs[i - first], liberty_files.empty() && genlib_files.empty(), simcheck)) {
+					outputs[i - first].clear();
+					jobs[i].release();
+					continue;
+				}
+				for (auto cell : jobs[i].extracted_cells)
+					jobs[i].module->remove(cell);
+				orlo_reintegrate(design, jobs[i], outputs[i - first], liberty_files, genlib_files, sop_mode);
+				outputs[i - first].clear();
+				jobs[i].release();
+			}
+			next_module++;
+		};
+
 		for (auto mod : design->selected_modules()) {
 			if (mod->processes.size() > 0) {
 				log("Skipping module %s as it contains processes.\n", log_id(mod));
 				continue;
 			}
 
-			assign_map.set(mod);
-			initvals.set(&assign_map, mod);
-
+			size_t first_job = jobs.size();
 			if (!dff_mode || !clk_str.empty()) {
-				orlo_module_reint(design, mod, liberty_files, genlib_files, dff_mode, clk_str, keepff,
-                                 mod->selected_cells(), sop_mode, abc_dir, 0);
-					   
-				continue;
-			}
-
-			CellTypes ct(design);
-
-			std::vector<RTLIL::Cell *> all_cells = mod->selected_cells();
-			std::set<RTLIL::Cell *> unassigned_cells(all_cells.begin(), all_cells.end());
-
-			std::set<RTLIL::Cell *> expand_queue, next_expand_queue;
-			std::set<RTLIL::Cell *> expand_queue_up, next_expand_queue_up;
-			std::set<RTLIL::Cell *> expand_queue_down, next_expand_queue_down;
-
-			typedef tuple<bool, RTLIL::SigSpec, bool, RTLIL::SigSpec> clkdomain_t;
-			std::map<clkdomain_t, std::vector<RTLIL::Cell *>> assigned_cells;
-			std::map<RTLIL::Cell *, clkdomain_t> assigned_cells_reverse;
-
-			std::map<RTLIL::Cell *, std::set<RTLIL::SigBit>> cell_to_bit, cell_to_bit_up, cell_to_bit_down;
-			std::map<RTLIL::SigBit, std::set<RTLIL::Cell *>> bit_to_cell, bit_to_cell_up, bit_to_cell_down;
-
-			for (auto cell : all_cells) {
-				clkdomain_t key;
-
-				for (auto &conn : cell->connections())
-					for (auto bit : conn.second) {
-						bit = assign_map(bit);
-						if (bit.wire != nullptr) {
-							cell_to_bit[cell].insert(bit);
-							bit_to_cell[bit].insert(cell);
-							if (ct.cell_input(cell->type, conn.first)) {
-								cell_to_bit_up[cell].insert(bit);
-								bit_to_cell_down[bit].insert(cell);
-							}
-							if (ct.cell_output(cell->type, conn.first)) {
-								cell_to_bit_down[cell].insert(bit);
-								bit_to_cell_up[bit].insert(cell);
-							}
-						}
-					}
-
-				if (cell->type.in(ID($_DFF_N_), ID($_DFF_P_))) {
-					key = clkdomain_t(cell->type == ID($_DFF_P_), assign_map(cell->getPort(ID::C)), true, RTLIL::SigSpec());
-				} else if (cell->type.in(ID($_DFFE_NN_), ID($_DFFE_NP_), ID($_DFFE_PN_), ID($_DFFE_PP_))) {
-					bool this_clk_pol = cell->type.in(ID($_DFFE_PN_), ID($_DFFE_PP_));
-					bool this_en_pol = cell->type.in(ID($_DFFE_NP_), ID($_DFFE_PP_));
-					key =
-					  clkdomain_t(this_clk_pol, assign_map(cell->getPort(ID::C)), this_en_pol, assign_map(cell->getPort(ID::E)));
-				} else
-					continue;
-
-				unassigned_cells.erase(cell);
-				expand_queue.insert(cell);
-				expand_queue_up.insert(cell);
-				expand_queue_down.insert(cell);
-
-				assigned_cells[key].push_back(cell);
-				assigned_cells_reverse[cell] = key;
-			}
-
-			while (!expand_queue_up.empty() || !expand_queue_down.empty()) {
-				if (!expand_queue_up.empty()) {
-					RTLIL::Cell *cell = *expand_queue_up.begin();
-					clkdomain_t key = assigned_cells_reverse.at(cell);
-					expand_queue_up.erase(cell);
-
-					for (auto bit : cell_to_bit_up[cell])
-						for (auto c : bit_to_cell_up[bit])
-							if (unassigned_cells.count(c)) {
-								unassigned_cells.erase(c);
-								next_expand_queue_up.insert(c);
-								assigned_cells[key].push_back(c);
-								assigned_cells_reverse[c] = key;
-								expand_queue.insert(c);
-							}
-				}
-
-				if (!expand_queue_down.empty()) {
-					RTLIL::Cell *cell = *expand_queue_down.begin();
-					clkdomain_t key = assigned_cells_reverse.at(cell);
-					expand_queue_down.erase(cell);
-
-					for (auto bit : cell_to_bit_down[cell])
-						for (auto c : bit_to_cell_down[bit])
-							if (unassigned_cells.count(c)) {
-								unassigned_cells.erase(c);
-								next_expand_queue_up.insert(c);
-								assigned_cells[key].push_back(c);
-								assigned_cells_reverse[c] = key;
-								expand_queue.insert(c);
-							}
+				std::vector<std::vector<RTLIL::Cell*>> parts = orlo_split_cells(mod, mod->selected_cells(), max_gates);
+				for (int i = 0; i < GetSize(parts); i++) {
+					jobs.emplace_back(mod);
+					jobs.back().part = i;
+					orlo_module_reint(jobs.back(), dff_mode, clk_str, keepff,
+                                     parts[i], abc_dir, i, manifest);
 				}
-
-				if (expand_queue_up.empty() && expand_queue_down.empty()) {
-					expand_queue_up.swap(next_expand_queue_up);
-					expand_queue_down.swap(next_expand_queue_down);
-				}
-			}
-
-			while (!expand_queue.empty()) {
-				RTLIL::Cell *cell = *expand_queue.begin();
-				clkdomain_t key = assigned_cells_reverse.at(cell);
-				expand_queue.erase(cell);
-
-				for (auto bit : cell_to_bit.at(cell)) {
-					for (auto c : bit_to_cell[bit])
-						if (unassigned_cells.count(c)) {
-							unassigned_cells.erase(c);
-							next_expand_queue.insert(c);
-							assigned_cells[key].push_back(c);
-							assigned_cells_reverse[c] = key;
-						}
-					bit_to_cell[bit].clear();
+			} else {
+				orlo_phase_timer_t partition_timer;
+				std::map<clkdomain_t, std::vector<RTLIL::Cell*>> assigned_cells = orlo_clock_domains(design, mod, mod->selected_cells());
+				partitions.push_back(std::make_pair(mod->name, partition_timer.stop()));
+
+				int clk_domain = 0;
+				for (auto &it : assigned_cells) {
+					std::vector<std::vector<RTLIL::Cell*>> parts = orlo_split_cells(mod, it.second, max_gates);
+					std::vector<RTLIL::Cell*>().swap(it.second);
+					for (int i = 0; i < GetSize(parts); i++) {
+						jobs.emplace_back(mod);
+						orlo_job_t &job = jobs.back();
+						job.part = i;
+						job.clk_polarity = std::get<0>(it.first);
+						job.clk_sig = job.assign_map(std::get<1>(it.first));
+						job.en_polarity = std::get<2>(it.first);
+						job.en_sig = job.assign_map(std::get<3>(it.first));
+
+						orlo_module_reint(job, !job.clk_sig.empty(), "$", keepff,
+								parts[i], abc_dir, clk_domain, manifest);
+						std::vector<RTLIL::Cell*>().swap(parts[i]);
+						clk_domain++;
+					}
 				}
-
-				if (expand_queue.empty())
-					expand_queue.swap(next_expand_queue);
 			}
 
-			clkdomain_t key(true, RTLIL::SigSpec(), true, RTLIL::SigSpec());
-			for (auto cell : unassigned_cells) {
-				assigned_cells[key].push_back(cell);
-				assigned_cells_reverse[cell] = key;
-			}
+			module_jobs.push_back(std::make_pair(first_job, jobs.size()));
+			if (pipeline > 0 && module_jobs.size() - next_module > size_t(pipeline))
+				finish_module();
+		}
 
-			log_header(design, "Summary of detected clock domains:\n");
-			for (auto &it : assigned_cells)
-				log("  %d cells in clk=%s%s, en=%s%s\n", GetSize(it.second), std::get<0>(it.first) ? "" : "!",
-				    log_signal(std::get<1>(it.first)), std::get<2>(it.first) ? "" : "!", log_signal(std::get<3>(it.first)));
+		while (next_module < module_jobs.size())
+			finish_module();
 
-            int clk_domain = 0;
-			for (auto &it : assigned_cells) {
-				clk_polarity = std::get<0>(it.first);
-				clk_sig = assign_map(std::get<1>(it.first));
-				en_polarity = std::get<2>(it.first);
-				en_sig = assign_map(std::get<3>(it.first));
+		if (simcheck > 0)
+			orlo_simcheck_summary(design, jobs);
 
-                orlo_module_reint(design, mod, liberty_files, genlib_files, !clk_sig.empty(), "$", keepff,
-  					             it.second, sop_mode, abc_dir, clk_domain);
-				assign_map.set(mod);
-                clk_domain++;
-			}
+		if (!stats_file.empty()) {
+			rewrite_filename(stats_file);
+			orlo_write_stats(stats_file, partitions, jobs, total_timer.stop());
 		}
 
-		assign_map.clear();
-		signal_list.clear();
-		signal_map.clear();
-		initvals.clear();
-		pi_map.clear();
-		po_map.clear();
-
 		log_pop();
 	}
 } OrloReintegratePass;